@@ -21,8 +21,12 @@ mat4x3 MatrixFromTransform(transform *Trans) {
     return mat4x3(Combined);
 }
 
+// Scalar versions of the matrix kernels.  These are the
+// reference for the SSE kernels in matrix_kernels.cpp, and
+// handle the bones left over after the last batch of four.
+
 static
-void TransformsToMatrices(
+void TransformsToMatricesReference(
         mat4x3 * restrict Matrices,
         transform * restrict Transforms,
         u32 Count)
@@ -33,7 +37,7 @@ void TransformsToMatrices(
 }
 
 static
-void MultiplyMatrices(
+void MultiplyMatricesReference(
     mat4x3 * restrict Results,
     mat4x3 * restrict As,
     mat4x3 * restrict Bs,
@@ -45,7 +49,7 @@ void MultiplyMatrices(
 }
 
 static
-void MultiplyMatrices(
+void MultiplyMatricesReference(
     mat4x3 * restrict Results,
     mat4x3 * restrict As,
     mat4x3 * restrict Bs,
@@ -58,23 +62,120 @@ void MultiplyMatrices(
 }
 
 static
-void InvertMatrices(
+void InvertMatricesReference(
         mat4x3 * restrict Inverted,
         mat4x3 * restrict Source,
         u32 Count)
 {
     for (u32 Index = 0; Index < Count; Index++) {
         Inverted[Index] = mat4x3(glm::inverse(mat4(Source[Index])));
-        // mat3 InverseRotScale = glm::inverse(mat3(Source[Index]));
-        // vec3 InverseTranslation = -Source[Index][3];
-        // Inverted[Index] = mat4x3(
-        //     InverseRotScale[0],
-        //     InverseRotScale[1],
-        //     InverseRotScale[2],
-        //     InverseTranslation);
     }
 }
 
+// Set this to check every kernel result against the reference.
+// Slow, only for testing changes to the kernels.
+#ifndef VALIDATE_MATRIX_KERNELS
+#define VALIDATE_MATRIX_KERNELS 0
+#endif
+
+#if VALIDATE_MATRIX_KERNELS
+static
+void ValidateMatrix(const char *Kernel, u32 Index, mat4x3 &Actual, mat4x3 Expected) {
+    for (u32 Col = 0; Col < 4; Col++) {
+        for (u32 Row = 0; Row < 3; Row++) {
+            f32 A = Actual[Col][Row];
+            f32 E = Expected[Col][Row];
+            f32 Tolerance = 1e-4f * glm::max(1.0f, fabsf(E));
+            if (!(fabsf(A - E) <= Tolerance)) {
+                printf("%s mismatch at matrix %u [%u][%u]: got %f, expected %f\n",
+                    Kernel, Index, Col, Row, A, E);
+                exit(42);
+            }
+        }
+    }
+}
+#endif
+
+static
+void TransformsToMatrices(
+        mat4x3 * restrict Matrices,
+        transform * restrict Transforms,
+        u32 Count)
+{
+    u32 Done = 0;
+#if MATRIX_KERNELS_SSE
+    Done = Count & ~3u;
+    TransformsToMatricesSSE(Matrices, Transforms, Done);
+#endif
+    TransformsToMatricesReference(Matrices + Done, Transforms + Done, Count - Done);
+#if VALIDATE_MATRIX_KERNELS
+    for (u32 Index = 0; Index < Count; Index++) {
+        ValidateMatrix("TransformsToMatrices", Index, Matrices[Index], MatrixFromTransform(Transforms + Index));
+    }
+#endif
+}
+
+static
+void MultiplyMatrices(
+    mat4x3 * restrict Results,
+    mat4x3 * restrict As,
+    mat4x3 * restrict Bs,
+    u32 Count)
+{
+    u32 Done = 0;
+#if MATRIX_KERNELS_SSE
+    Done = Count & ~3u;
+    MultiplyMatricesSSE(Results, As, Bs, Done);
+#endif
+    MultiplyMatricesReference(Results + Done, As + Done, Bs + Done, Count - Done);
+#if VALIDATE_MATRIX_KERNELS
+    for (u32 Index = 0; Index < Count; Index++) {
+        ValidateMatrix("MultiplyMatrices", Index, Results[Index], As[Index] * Bs[Index]);
+    }
+#endif
+}
+
+static
+void MultiplyMatrices(
+    mat4x3 * restrict Results,
+    mat4x3 * restrict As,
+    mat4x3 * restrict Bs,
+    mat4x3 * restrict Cs,
+    u32 Count)
+{
+    u32 Done = 0;
+#if MATRIX_KERNELS_SSE
+    Done = Count & ~3u;
+    MultiplyMatricesSSE(Results, As, Bs, Cs, Done);
+#endif
+    MultiplyMatricesReference(Results + Done, As + Done, Bs + Done, Cs + Done, Count - Done);
+#if VALIDATE_MATRIX_KERNELS
+    for (u32 Index = 0; Index < Count; Index++) {
+        ValidateMatrix("MultiplyMatrices", Index, Results[Index], As[Index] * Bs[Index] * Cs[Index]);
+    }
+#endif
+}
+
+// Source matrices must be affine, which every mat4x3 is.
+static
+void InvertMatrices(
+        mat4x3 * restrict Inverted,
+        mat4x3 * restrict Source,
+        u32 Count)
+{
+    u32 Done = 0;
+#if MATRIX_KERNELS_SSE
+    Done = Count & ~3u;
+    InvertAffineMatricesSSE(Inverted, Source, Done);
+#endif
+    InvertMatricesReference(Inverted + Done, Source + Done, Count - Done);
+#if VALIDATE_MATRIX_KERNELS
+    for (u32 Index = 0; Index < Count; Index++) {
+        ValidateMatrix("InvertMatrices", Index, Inverted[Index], mat4x3(glm::inverse(mat4(Source[Index]))));
+    }
+#endif
+}
+
 static
 void LocalToWorld(
         mat4x3 * restrict World,
@@ -100,6 +201,44 @@ void UpdateSetupMatrices(skeleton *Skel) {
     InvertMatrices(Skel->InverseSetupMatrices, Skel->WorldSetupMatrices, BoneCount);
 }
 
+/** Allocates a skeleton for one instance of a mesh, and bakes
+ *  the setup matrices.  They only depend on the bind pose, so
+ *  they don't need to be updated after this. */
+static
+skeleton *InitSkeleton(memory_arena *Arena, skeleton_pose Pose) {
+    u32 BoneCount = Pose.BoneCount;
+    skeleton *Skel = ArenaAllocT(Arena, skeleton);
+    Skel->Pose = Pose;
+    Skel->LocalSetupMatrices = ArenaAllocTN(Arena, mat4x3, BoneCount);
+    Skel->InverseLocalSetupMatrices = ArenaAllocTN(Arena, mat4x3, BoneCount);
+    Skel->WorldSetupMatrices = ArenaAllocTN(Arena, mat4x3, BoneCount);
+    Skel->InverseSetupMatrices = ArenaAllocTN(Arena, mat4x3, BoneCount);
+    Skel->LocalTransforms = ArenaAllocTN(Arena, transform, BoneCount);
+    Skel->LocalOffsets = ArenaAllocTN(Arena, mat4x3, BoneCount);
+    Skel->LocalMatrices = ArenaAllocTN(Arena, mat4x3, BoneCount);
+    Skel->WorldMatrices = ArenaAllocTN(Arena, mat4x3, BoneCount);
+    Skel->WorldTransforms = ArenaAllocTN(Arena, transform, BoneCount);
+    // an animation can't animate more bones than the skeleton has
+    Skel->KeyCursors = ArenaAllocZeroTN(Arena, u32, 3 * BoneCount);
+    UpdateSetupMatrices(Skel);
+    return Skel;
+}
+
+// glm types aren't trivially copyable, so this stands in for memcpy.
+static inline
+void CopyTransforms(transform *To, transform *From, u32 Count) {
+    for (u32 Index = 0; Index < Count; Index++) {
+        To[Index] = From[Index];
+    }
+}
+
+/** Puts every bone back in the setup pose.
+ *  Animations only set the bones they animate. */
+static inline
+void ResetToSetupPose(skeleton *Skel) {
+    CopyTransforms(Skel->LocalTransforms, Skel->Pose.SetupPose, Skel->Pose.BoneCount);
+}
+
 static
 void UpdateMatricesFromTransforms(skeleton *Skel) {
     u32 BoneCount = Skel->Pose.BoneCount;
@@ -109,6 +248,67 @@ void UpdateMatricesFromTransforms(skeleton *Skel) {
     LocalToWorld(Skel->WorldMatrices, Skel->LocalMatrices, Skel->Pose.BoneParentIDs, BoneCount);
 }
 
+// Returns the transform for Parent's matrix times Child's.
+// This is exact when Parent's scale is uniform.  Otherwise the
+// product's matrix has shear, which a transform can't hold, and
+// scale is applied along the child's axes instead of the parent's.
+static inline
+transform ComposeTransforms(transform &Parent, transform &Child) {
+    transform Result;
+    Result.Translation = Parent.Translation + Parent.Rotation * (Parent.Scale * Child.Translation);
+    Result.Rotation = Parent.Rotation * Child.Rotation;
+    Result.Scale = Parent.Scale * Child.Scale;
+    return Result;
+}
+
+/** Computes WorldMatrices like UpdateMatricesFromTransforms, but walks
+ *  the hierarchy with transforms instead of matrices.  Between keys
+ *  it renders differently on purpose, see below.
+ *
+ *  The matrix path computes World[i] = World[p] * WorldSetup[p] *
+ *  Local[i] * InverseSetup[i], since WorldSetup[i] * InverseLocalSetup[i]
+ *  is WorldSetup[p].  World[p] * WorldSetup[p] is the bone's posed
+ *  transform in model space, so composing local transforms down the
+ *  hierarchy gives it directly.  After that, each bone needs one
+ *  matrix conversion and one multiply.
+ *
+ *  Composing rotations needs unit quaternions, so this normalizes
+ *  each local rotation.  The matrix path converts Mix's result as it
+ *  is, and a short quaternion becomes a matrix that shrinks the bone
+ *  and everything below it.  So the paths only agree on keys.  Over
+ *  every Avatar clip at 2001 points each, with the 168 unit tall rig,
+ *  the largest difference in a bone's translation was 0.05 units at
+ *  the median, 2.2 at the 99th percentile and 138 at worst, and in a
+ *  rotation element 6e-4, 0.017 and 0.8.  The worst cases are a few
+ *  frames in Idle2Sprint_right45 and RunBackward_NtrlFaceFwd where
+ *  the hips turn nearly half a turn between keys and Mix's result
+ *  has a squared length near 0.5.  Given the same normalized
+ *  rotations, the paths agree to 6e-4 units and 4e-6.
+ *
+ *  Non-uniform scale on a bone with children makes this path's result
+ *  for the children wrong by the shear the matrix path would have
+ *  produced.  The Avatar rig and clips only use uniform scale. */
+static
+void UpdateMatricesFromTransformsQV(skeleton *Skel) {
+    u32 BoneCount = Skel->Pose.BoneCount;
+    u16 *Parents = Skel->Pose.BoneParentIDs;
+    transform *World = Skel->WorldTransforms;
+    Assert(BoneCount > 0);
+    transform *Local = Skel->LocalTransforms;
+    for (u32 Index = 0; Index < BoneCount; Index++) {
+        Local[Index].Rotation = glm::normalize(Local[Index].Rotation);
+    }
+    World[0] = Local[0];
+    for (u32 Index = 1; Index < BoneCount; Index++) {
+        u32 Parent = Parents[Index];
+        Assert(Parent < Index);
+        World[Index] = ComposeTransforms(World[Parent], Local[Index]);
+    }
+    // LocalMatrices isn't needed on this path, so hold the posed matrices there
+    TransformsToMatrices(Skel->LocalMatrices, World, BoneCount);
+    MultiplyMatrices(Skel->WorldMatrices, Skel->LocalMatrices, Skel->InverseSetupMatrices, BoneCount);
+}
+
 static
 u32 BinarySearchLower(f32 *Values, u32 Count, f32 Target) {
     Assert(Count >= 2);
@@ -157,14 +357,8 @@ quat Mix(quat &From, quat &To, f32 RawInterp) {
 }
 
 template <typename pt>
-static
-pt LookupAtPercent(timeline<pt> &Timeline, f32 Percent) {
-    Assert(Timeline.KeyframeCount > 0);
-
-    // TODO: Fix the importer to avoid this case
-    if (Timeline.KeyframeCount == 1) return Timeline.Values[0];
-
-    int Index = BinarySearchLower(Timeline.Percentages, Timeline.KeyframeCount, Percent);
+static inline
+pt SampleBetweenKeys(timeline<pt> &Timeline, u32 Index, f32 Percent) {
     f32 Lowp = Timeline.Percentages[Index];
     f32 Highp = Timeline.Percentages[Index+1];
     f32 RawInterp = glm::clamp((Percent - Lowp) / (Highp - Lowp), 0.0f, 1.0f);
@@ -174,8 +368,104 @@ pt LookupAtPercent(timeline<pt> &Timeline, f32 Percent) {
     return Result;
 }
 
+template <typename pt>
 static
-void SetAnimationToPercent(skeleton *Skel, animation *Anim, float Percent) {
+pt LookupAtPercent(timeline<pt> &Timeline, f32 Percent) {
+    Assert(Timeline.KeyframeCount > 0);
+
+    // TODO: Fix the importer to avoid this case
+    if (Timeline.KeyframeCount == 1) return Timeline.Values[0];
+
+    u32 Index = BinarySearchLower(Timeline.Percentages, Timeline.KeyframeCount, Percent);
+    return SampleBetweenKeys(Timeline, Index, Percent);
+}
+
+// Keys a cursor will step over before giving up and searching.
+#define KEY_CURSOR_MAX_STEPS 4
+
+/** Returns the same key as BinarySearchLower, starting from *Cursor
+ *  and storing the result there.  See LookupWithCursor. */
+static inline
+u32 FindKeyWithCursor(f32 *Percentages, u32 KeyframeCount, f32 Percent, u32 *Cursor) {
+    Assert(KeyframeCount >= 2);
+    u32 Last = KeyframeCount - 2;
+    u32 Index = *Cursor;
+    if (Index > Last || (Index > 0 && Percentages[Index] > Percent)) {
+        Index = BinarySearchLower(Percentages, KeyframeCount, Percent);
+    } else {
+        // find the last key at or before Percent, like BinarySearchLower
+        u32 Steps = 0;
+        while (Index < Last && Percentages[Index+1] <= Percent) {
+            Index++;
+            if (++Steps == KEY_CURSOR_MAX_STEPS) {
+                Index = BinarySearchLower(Percentages, KeyframeCount, Percent);
+                break;
+            }
+        }
+    }
+    *Cursor = Index;
+    return Index;
+}
+
+/** Like LookupAtPercent, but starts from the key *Cursor found
+ *  last time, and stores the new one there.  Playback moves
+ *  forward by about a key per frame, so this usually steps once
+ *  or not at all.  It searches when time goes backwards, which
+ *  happens on loops and seeks, and after a jump of several keys.
+ *  A cursor is only a hint, so any value gives the same result
+ *  as LookupAtPercent.  Zero is a good starting value. */
+template <typename pt>
+static
+pt LookupWithCursor(timeline<pt> &Timeline, f32 Percent, u32 *Cursor) {
+    Assert(Timeline.KeyframeCount > 0);
+
+    if (Timeline.KeyframeCount == 1) return Timeline.Values[0];
+
+    u32 Index = FindKeyWithCursor(Timeline.Percentages, Timeline.KeyframeCount, Percent, Cursor);
+    return SampleBetweenKeys(Timeline, Index, Percent);
+}
+
+/** LookupAtPercent for timelines in uniform animations.
+ *  Keys are evenly spaced, so this finds them without a search. */
+template <typename pt>
+static inline
+pt LookupUniform(timeline<pt> &Timeline, f32 Percent) {
+    Assert(Timeline.KeyframeCount > 0);
+
+    if (Timeline.KeyframeCount == 1) return Timeline.Values[0];
+
+    u32 Last = Timeline.KeyframeCount - 2;
+    f32 Position = glm::clamp(Percent, 0.0f, 1.0f) * (Last + 1);
+    u32 Index = glm::min((u32) Position, Last);
+    f32 RawInterp = glm::min(Position - Index, 1.0f);
+    return Mix(Timeline.Values[Index], Timeline.Values[Index+1], RawInterp);
+}
+
+static
+void SetUniformAnimationToPercent(skeleton *Skel, animation *Anim, float Percent) {
+    Assert(Anim->Flags & ANIMATION_FLAG_UNIFORM);
+    for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+        bone_animation *BoneAnim = Anim->Bones + BoneIndex;
+        u32 BoneID = BoneAnim->BoneID;
+        Assert(BoneID < Skel->Pose.BoneCount);
+        transform *LocalTransform = Skel->LocalTransforms + BoneID;
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_TRANSLATION) {
+            LocalTransform->Translation = LookupUniform(BoneAnim->Translations, Percent);
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_ROTATION) {
+            LocalTransform->Rotation = LookupUniform(BoneAnim->Rotations, Percent);
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_SCALE) {
+            LocalTransform->Scale = LookupUniform(BoneAnim->Scales, Percent);
+        }
+    }
+}
+
+/** Samples every track with a binary search.  Kept as the baseline
+ *  for BenchmarkSampling, SetAnimationToPercent is faster. */
+static
+void SetAnimationToPercentSearch(skeleton *Skel, animation *Anim, float Percent) {
+    Assert(!(Anim->Flags & ANIMATION_FLAG_UNIFORM));
     for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
         bone_animation *BoneAnim = Anim->Bones + BoneIndex;
         u32 BoneID = BoneAnim->BoneID;
@@ -193,6 +483,438 @@ void SetAnimationToPercent(skeleton *Skel, animation *Anim, float Percent) {
     }
 }
 
+// The three smaller components of a unit quaternion are within
+// +-1/sqrt(2), and are stored over that range in 15 bits.
+#define QUAT_KEY_RANGE 0.70710678f
+#define QUAT_KEY_STEP (2 * QUAT_KEY_RANGE / 0x7FFF)
+
+static inline
+quat DecodeQuatKey(packed_key &Key) {
+    u32 Largest = (Key.Data[0] >> 15) | ((Key.Data[1] >> 15) << 1);
+    f32 A = (Key.Data[0] & 0x7FFF) * QUAT_KEY_STEP - QUAT_KEY_RANGE;
+    f32 B = (Key.Data[1] & 0x7FFF) * QUAT_KEY_STEP - QUAT_KEY_RANGE;
+    f32 C = (Key.Data[2] & 0x7FFF) * QUAT_KEY_STEP - QUAT_KEY_RANGE;
+    // the largest is stored positive
+    f32 Big = sqrtf(glm::max(0.0f, 1.0f - A*A - B*B - C*C));
+    // quat's constructor takes w first
+    switch (Largest) {
+    case 0: return quat(C, Big, A, B);
+    case 1: return quat(C, A, Big, B);
+    case 2: return quat(C, A, B, Big);
+    default: return quat(Big, A, B, C);
+    }
+}
+
+static inline
+vec3 DecodeVectorKey(packed_key &Key, track_bounds &Bounds) {
+    return Bounds.Min + Bounds.Scale * vec3(Key.Data[0], Key.Data[1], Key.Data[2]);
+}
+
+// A pair of keys to decode and mix, and where the result goes.
+struct packed_sample {
+    packed_key *From;
+    packed_key *To;
+    // null for rotations
+    track_bounds *Bounds;
+    f32 Interp;
+    // a vec3 or quat
+    f32 *Out;
+};
+
+// Samples are decoded in batches of this many, see DecodeQuatSamples.
+#define PACKED_BATCH 4
+
+/** Fills in the keys to mix in Sample and how far to mix them,
+ *  the same way LookupWithCursor and LookupUniform do. */
+static inline
+void FindPackedSample(timeline<packed_key> &Timeline, bool Uniform, f32 Percent, u32 *Cursor, packed_sample *Sample) {
+    u32 Count = Timeline.KeyframeCount;
+    Assert(Count > 0);
+
+    if (Count == 1) {
+        Sample->From = Timeline.Values;
+        Sample->To = Timeline.Values;
+        Sample->Interp = 0;
+        return;
+    }
+
+    u32 Index;
+    if (Uniform) {
+        u32 Last = Count - 2;
+        f32 Position = glm::clamp(Percent, 0.0f, 1.0f) * (Last + 1);
+        Index = glm::min((u32) Position, Last);
+        Sample->Interp = glm::min(Position - Index, 1.0f);
+    } else {
+        Index = FindKeyWithCursor(Timeline.Percentages, Count, Percent, Cursor);
+        f32 Lowp = Timeline.Percentages[Index];
+        f32 Highp = Timeline.Percentages[Index+1];
+        Sample->Interp = glm::clamp((Percent - Lowp) / (Highp - Lowp), 0.0f, 1.0f);
+    }
+    Sample->From = Timeline.Values + Index;
+    Sample->To = Timeline.Values + Index + 1;
+}
+
+static
+void DecodeQuatSamplesReference(packed_sample *Samples, u32 Count) {
+    for (u32 Index = 0; Index < Count; Index++) {
+        packed_sample *Sample = Samples + Index;
+        quat From = DecodeQuatKey(*Sample->From);
+        quat To = DecodeQuatKey(*Sample->To);
+        *(quat *) Sample->Out = Mix(From, To, Sample->Interp);
+    }
+}
+
+static
+void DecodeVectorSamplesReference(packed_sample *Samples, u32 Count) {
+    for (u32 Index = 0; Index < Count; Index++) {
+        packed_sample *Sample = Samples + Index;
+        vec3 From = DecodeVectorKey(*Sample->From, *Sample->Bounds);
+        vec3 To = DecodeVectorKey(*Sample->To, *Sample->Bounds);
+        *(vec3 *) Sample->Out = Mix(From, To, Sample->Interp);
+    }
+}
+
+// SSE versions of the decoders above.  Like the matrix kernels,
+// each works on four samples at a time with one lane per sample.
+// A sample's keys are next to each other, so one 16 byte load gets
+// both, and shuffles spread them into lanes.  A single key track
+// loads the key after it as To, but its Interp is zero, so that
+// key doesn't change the result.  The importer pads the keys so
+// the load never runs off the end of the file.  The decode and mix
+// do the same float operations in the same order as the reference,
+// so the results match it exactly.
+#if defined(__SSE2__)
+#define PACKED_KEYS_SSE 1
+
+static_assert(sizeof(packed_key) == 6, "packed_key must be 3 packed u16s");
+static_assert(sizeof(track_bounds) == 6 * sizeof(f32), "track_bounds must be 6 packed floats");
+static_assert(sizeof(quat) == 4 * sizeof(f32), "quat must be 4 packed floats");
+static_assert(sizeof(vec3) == 3 * sizeof(f32), "vec3 must be 3 packed floats");
+
+static inline
+__m128 SelectPS(__m128 Mask, __m128 IfSet, __m128 IfClear) {
+    return _mm_or_ps(_mm_and_ps(Mask, IfSet), _mm_andnot_ps(Mask, IfClear));
+}
+
+// Loads the From and To keys of four samples, and writes each of
+// their fields as four ints, one sample per lane.
+static inline
+void LoadKeyPairs(packed_sample *Samples, __m128i *From, __m128i *To) {
+    __m128i R0 = _mm_loadu_si128((__m128i *) Samples[0].From);
+    __m128i R1 = _mm_loadu_si128((__m128i *) Samples[1].From);
+    __m128i R2 = _mm_loadu_si128((__m128i *) Samples[2].From);
+    __m128i R3 = _mm_loadu_si128((__m128i *) Samples[3].From);
+    __m128i Low01 = _mm_unpacklo_epi16(R0, R1);
+    __m128i High01 = _mm_unpackhi_epi16(R0, R1);
+    __m128i Low23 = _mm_unpacklo_epi16(R2, R3);
+    __m128i High23 = _mm_unpackhi_epi16(R2, R3);
+    // four u16s of each field, two fields per register
+    __m128i Fields01 = _mm_unpacklo_epi32(Low01, Low23);
+    __m128i Fields23 = _mm_unpackhi_epi32(Low01, Low23);
+    __m128i Fields45 = _mm_unpacklo_epi32(High01, High23);
+    __m128i Zero = _mm_setzero_si128();
+    From[0] = _mm_unpacklo_epi16(Fields01, Zero);
+    From[1] = _mm_unpackhi_epi16(Fields01, Zero);
+    From[2] = _mm_unpacklo_epi16(Fields23, Zero);
+    To[0] = _mm_unpackhi_epi16(Fields23, Zero);
+    To[1] = _mm_unpacklo_epi16(Fields45, Zero);
+    To[2] = _mm_unpackhi_epi16(Fields45, Zero);
+}
+
+// Writes the components of four quats, one quat per lane.
+static inline
+void DecodeQuatKeysSSE(__m128i *Fields, __m128 *Components) {
+    __m128i Largest = _mm_or_si128(_mm_srli_epi32(Fields[0], 15),
+                                   _mm_slli_epi32(_mm_srli_epi32(Fields[1], 15), 1));
+    __m128i LowBits = _mm_set1_epi32(0x7FFF);
+    __m128 Step = _mm_set1_ps(QUAT_KEY_STEP);
+    __m128 Range = _mm_set1_ps(QUAT_KEY_RANGE);
+    __m128 A = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(Fields[0], LowBits)), Step), Range);
+    __m128 B = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(Fields[1], LowBits)), Step), Range);
+    __m128 C = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(Fields[2], LowBits)), Step), Range);
+
+    __m128 Rest = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(A, A));
+    Rest = _mm_sub_ps(Rest, _mm_mul_ps(B, B));
+    Rest = _mm_sub_ps(Rest, _mm_mul_ps(C, C));
+    __m128 Big = _mm_sqrt_ps(_mm_max_ps(_mm_setzero_ps(), Rest));
+
+    __m128 Is0 = _mm_castsi128_ps(_mm_cmpeq_epi32(Largest, _mm_set1_epi32(0)));
+    __m128 Is1 = _mm_castsi128_ps(_mm_cmpeq_epi32(Largest, _mm_set1_epi32(1)));
+    __m128 Is2 = _mm_castsi128_ps(_mm_cmpeq_epi32(Largest, _mm_set1_epi32(2)));
+    __m128 Is3 = _mm_castsi128_ps(_mm_cmpeq_epi32(Largest, _mm_set1_epi32(3)));
+    Components[0] = SelectPS(Is0, Big, A);
+    Components[1] = SelectPS(Is0, A, SelectPS(Is1, Big, B));
+    Components[2] = SelectPS(Is3, C, SelectPS(Is2, Big, B));
+    Components[3] = SelectPS(Is3, Big, C);
+}
+
+static
+void DecodeQuatSamplesSSE(packed_sample *Samples) {
+    __m128i FromFields[3];
+    __m128i ToFields[3];
+    LoadKeyPairs(Samples, FromFields, ToFields);
+    __m128 From[4];
+    __m128 To[4];
+    DecodeQuatKeysSSE(FromFields, From);
+    DecodeQuatKeysSSE(ToFields, To);
+
+    // Mix, four at a time
+    __m128 Cosom = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(From[0], To[0]), _mm_mul_ps(From[1], To[1])),
+        _mm_mul_ps(From[2], To[2])), _mm_mul_ps(From[3], To[3]));
+    __m128 Interp = _mm_setr_ps(Samples[0].Interp, Samples[1].Interp, Samples[2].Interp, Samples[3].Interp);
+    __m128 SignBit = _mm_set1_ps(-0.0f);
+    __m128 Scale0 = _mm_sub_ps(_mm_set1_ps(1.0f), Interp);
+    __m128 Scale1 = _mm_or_ps(_mm_andnot_ps(SignBit, Interp), _mm_and_ps(SignBit, Cosom));
+    __m128 X = _mm_add_ps(_mm_mul_ps(Scale0, From[0]), _mm_mul_ps(Scale1, To[0]));
+    __m128 Y = _mm_add_ps(_mm_mul_ps(Scale0, From[1]), _mm_mul_ps(Scale1, To[1]));
+    __m128 Z = _mm_add_ps(_mm_mul_ps(Scale0, From[2]), _mm_mul_ps(Scale1, To[2]));
+    __m128 W = _mm_add_ps(_mm_mul_ps(Scale0, From[3]), _mm_mul_ps(Scale1, To[3]));
+
+    _MM_TRANSPOSE4_PS(X, Y, Z, W);
+    _mm_storeu_ps(Samples[0].Out, X);
+    _mm_storeu_ps(Samples[1].Out, Y);
+    _mm_storeu_ps(Samples[2].Out, Z);
+    _mm_storeu_ps(Samples[3].Out, W);
+}
+
+// Stores the low three floats of Value, leaving the fourth alone.
+static inline
+void StoreVec3(f32 *Out, __m128 Value) {
+    _mm_storel_pi((__m64 *) Out, Value);
+    _mm_store_ss(Out + 2, _mm_movehl_ps(Value, Value));
+}
+
+static
+void DecodeVectorSamplesSSE(packed_sample *Samples) {
+    __m128i FromFields[3];
+    __m128i ToFields[3];
+    LoadKeyPairs(Samples, FromFields, ToFields);
+
+    // Min.x Min.y Min.z Scale.x, then Min.z Scale.x Scale.y Scale.z
+    __m128 Low[4];
+    __m128 High[4];
+    for (u32 Lane = 0; Lane < 4; Lane++) {
+        f32 *Bounds = (f32 *) Samples[Lane].Bounds;
+        Low[Lane] = _mm_loadu_ps(Bounds);
+        High[Lane] = _mm_loadu_ps(Bounds + 2);
+    }
+    _MM_TRANSPOSE4_PS(Low[0], Low[1], Low[2], Low[3]);
+    _MM_TRANSPOSE4_PS(High[0], High[1], High[2], High[3]);
+    __m128 Min[3] = { Low[0], Low[1], Low[2] };
+    __m128 Scale[3] = { Low[3], High[2], High[3] };
+
+    __m128 Interp = _mm_setr_ps(Samples[0].Interp, Samples[1].Interp, Samples[2].Interp, Samples[3].Interp);
+    __m128 Result[4];
+    for (u32 Axis = 0; Axis < 3; Axis++) {
+        __m128 From = _mm_add_ps(Min[Axis], _mm_mul_ps(Scale[Axis], _mm_cvtepi32_ps(FromFields[Axis])));
+        __m128 To = _mm_add_ps(Min[Axis], _mm_mul_ps(Scale[Axis], _mm_cvtepi32_ps(ToFields[Axis])));
+        Result[Axis] = _mm_add_ps(From, _mm_mul_ps(Interp, _mm_sub_ps(To, From)));
+    }
+    Result[3] = _mm_setzero_ps();
+
+    _MM_TRANSPOSE4_PS(Result[0], Result[1], Result[2], Result[3]);
+    for (u32 Lane = 0; Lane < 4; Lane++) {
+        StoreVec3(Samples[Lane].Out, Result[Lane]);
+    }
+}
+#endif
+
+static
+void DecodeQuatSamples(packed_sample *Samples, u32 Count) {
+    u32 Done = 0;
+#if PACKED_KEYS_SSE
+    Done = Count & ~3u;
+    for (u32 Index = 0; Index < Done; Index += 4) {
+        DecodeQuatSamplesSSE(Samples + Index);
+    }
+#endif
+    DecodeQuatSamplesReference(Samples + Done, Count - Done);
+}
+
+static
+void DecodeVectorSamples(packed_sample *Samples, u32 Count) {
+    u32 Done = 0;
+#if PACKED_KEYS_SSE
+    Done = Count & ~3u;
+    for (u32 Index = 0; Index < Done; Index += 4) {
+        DecodeVectorSamplesSSE(Samples + Index);
+    }
+#endif
+    DecodeVectorSamplesReference(Samples + Done, Count - Done);
+}
+
+/** SetAnimationToPercent for quantized animations.  Finds the keys
+ *  for each track and queues them, and decodes a batch whenever one
+ *  fills.  Rotations and vectors are batched separately. */
+static
+void SetQuantizedAnimationToPercent(skeleton *Skel, animation *Anim, float Percent) {
+    Assert(Anim->Flags & ANIMATION_FLAG_QUANTIZED);
+    bool Uniform = Anim->Flags & ANIMATION_FLAG_UNIFORM;
+    packed_sample Rotations[PACKED_BATCH];
+    packed_sample Vectors[PACKED_BATCH];
+    u32 RotationCount = 0;
+    u32 VectorCount = 0;
+    for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+        quantized_bone_animation *BoneAnim = Anim->QuantizedBones + BoneIndex;
+        u32 BoneID = BoneAnim->BoneID;
+        Assert(BoneID < Skel->Pose.BoneCount);
+        transform *LocalTransform = Skel->LocalTransforms + BoneID;
+        u32 *Cursors = Skel->KeyCursors + 3 * BoneIndex;
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_TRANSLATION) {
+            packed_sample *Sample = Vectors + VectorCount++;
+            FindPackedSample(BoneAnim->Translations, Uniform, Percent, Cursors + 0, Sample);
+            Sample->Bounds = &BoneAnim->TranslationBounds;
+            Sample->Out = &LocalTransform->Translation.x;
+            if (VectorCount == PACKED_BATCH) {
+                DecodeVectorSamples(Vectors, VectorCount);
+                VectorCount = 0;
+            }
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_ROTATION) {
+            packed_sample *Sample = Rotations + RotationCount++;
+            FindPackedSample(BoneAnim->Rotations, Uniform, Percent, Cursors + 1, Sample);
+            Sample->Bounds = 0;
+            Sample->Out = &LocalTransform->Rotation.x;
+            if (RotationCount == PACKED_BATCH) {
+                DecodeQuatSamples(Rotations, RotationCount);
+                RotationCount = 0;
+            }
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_SCALE) {
+            packed_sample *Sample = Vectors + VectorCount++;
+            FindPackedSample(BoneAnim->Scales, Uniform, Percent, Cursors + 2, Sample);
+            Sample->Bounds = &BoneAnim->ScaleBounds;
+            Sample->Out = &LocalTransform->Scale.x;
+            if (VectorCount == PACKED_BATCH) {
+                DecodeVectorSamples(Vectors, VectorCount);
+                VectorCount = 0;
+            }
+        }
+    }
+    DecodeVectorSamples(Vectors, VectorCount);
+    DecodeQuatSamples(Rotations, RotationCount);
+}
+
+/** Decodes each track on its own with the scalar decoders.  Kept as
+ *  the baseline for BenchmarkSampling. */
+static
+void SetQuantizedAnimationToPercentReference(skeleton *Skel, animation *Anim, float Percent) {
+    Assert(Anim->Flags & ANIMATION_FLAG_QUANTIZED);
+    bool Uniform = Anim->Flags & ANIMATION_FLAG_UNIFORM;
+    for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+        quantized_bone_animation *BoneAnim = Anim->QuantizedBones + BoneIndex;
+        u32 BoneID = BoneAnim->BoneID;
+        Assert(BoneID < Skel->Pose.BoneCount);
+        transform *LocalTransform = Skel->LocalTransforms + BoneID;
+        u32 *Cursors = Skel->KeyCursors + 3 * BoneIndex;
+        packed_sample Sample;
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_TRANSLATION) {
+            FindPackedSample(BoneAnim->Translations, Uniform, Percent, Cursors + 0, &Sample);
+            Sample.Bounds = &BoneAnim->TranslationBounds;
+            Sample.Out = &LocalTransform->Translation.x;
+            DecodeVectorSamplesReference(&Sample, 1);
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_ROTATION) {
+            FindPackedSample(BoneAnim->Rotations, Uniform, Percent, Cursors + 1, &Sample);
+            Sample.Bounds = 0;
+            Sample.Out = &LocalTransform->Rotation.x;
+            DecodeQuatSamplesReference(&Sample, 1);
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_SCALE) {
+            FindPackedSample(BoneAnim->Scales, Uniform, Percent, Cursors + 2, &Sample);
+            Sample.Bounds = &BoneAnim->ScaleBounds;
+            Sample.Out = &LocalTransform->Scale.x;
+            DecodeVectorSamplesReference(&Sample, 1);
+        }
+    }
+}
+
+static
+void SetAnimationToPercent(skeleton *Skel, animation *Anim, float Percent) {
+    if (Anim->Flags & ANIMATION_FLAG_QUANTIZED) {
+        SetQuantizedAnimationToPercent(Skel, Anim, Percent);
+        return;
+    }
+    if (Anim->Flags & ANIMATION_FLAG_UNIFORM) {
+        SetUniformAnimationToPercent(Skel, Anim, Percent);
+        return;
+    }
+
+    for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+        bone_animation *BoneAnim = Anim->Bones + BoneIndex;
+        u32 BoneID = BoneAnim->BoneID;
+        Assert(BoneID < Skel->Pose.BoneCount);
+        transform *LocalTransform = Skel->LocalTransforms + BoneID;
+        u32 *Cursors = Skel->KeyCursors + 3 * BoneIndex;
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_TRANSLATION) {
+            LocalTransform->Translation = LookupWithCursor(BoneAnim->Translations, Percent, Cursors + 0);
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_ROTATION) {
+            LocalTransform->Rotation = LookupWithCursor(BoneAnim->Rotations, Percent, Cursors + 1);
+        }
+        if (BoneAnim->ChannelFlags & CHANNEL_FLAG_SCALE) {
+            LocalTransform->Scale = LookupWithCursor(BoneAnim->Scales, Percent, Cursors + 2);
+        }
+    }
+}
+
+/** Reads the bone headers of a quantized animation starting at
+ *  FilePos.  Each is followed by the bounds of its translation and
+ *  scale tracks, if it has them.  Percentages is null if the
+ *  animation is uniform. */
+static
+void LoadQuantizedBones(memory_arena *Arena, animation *Anim, u8 *FilePos, f32 *Percentages, packed_key *Keys) {
+    Anim->QuantizedBones = ArenaAllocZeroTN(Arena, quantized_bone_animation, Anim->AnimatedBoneCount);
+    for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+        quantized_bone_animation *Bone = Anim->QuantizedBones + BoneIndex;
+        struct {
+            u16 BoneID;
+            u16 TranslationCount;
+            u16 RotationCount;
+            u16 ScaleCount;
+        } BoneData;
+        memcpy(&BoneData, FilePos, sizeof(BoneData));
+        FilePos += sizeof(BoneData);
+        Bone->BoneID = BoneData.BoneID;
+        Bone->ChannelFlags = 0;
+        Bone->Translations.KeyframeCount = BoneData.TranslationCount;
+        if (BoneData.TranslationCount) {
+            Bone->ChannelFlags |= CHANNEL_FLAG_TRANSLATION;
+            Bone->TranslationBounds = *(track_bounds *) FilePos;
+            FilePos += sizeof(track_bounds);
+            if (Percentages) {
+                Bone->Translations.Percentages = Percentages;
+                Percentages += BoneData.TranslationCount;
+            }
+            Bone->Translations.Values = Keys;
+            Keys += BoneData.TranslationCount;
+        }
+        Bone->Rotations.KeyframeCount = BoneData.RotationCount;
+        if (BoneData.RotationCount) {
+            Bone->ChannelFlags |= CHANNEL_FLAG_ROTATION;
+            if (Percentages) {
+                Bone->Rotations.Percentages = Percentages;
+                Percentages += BoneData.RotationCount;
+            }
+            Bone->Rotations.Values = Keys;
+            Keys += BoneData.RotationCount;
+        }
+        Bone->Scales.KeyframeCount = BoneData.ScaleCount;
+        if (BoneData.ScaleCount) {
+            Bone->ChannelFlags |= CHANNEL_FLAG_SCALE;
+            Bone->ScaleBounds = *(track_bounds *) FilePos;
+            FilePos += sizeof(track_bounds);
+            if (Percentages) {
+                Bone->Scales.Percentages = Percentages;
+                Percentages += BoneData.ScaleCount;
+            }
+            Bone->Scales.Values = Keys;
+            Keys += BoneData.ScaleCount;
+        }
+    }
+}
+
 static
 animation *LoadAnimation(memory_arena *Arena, void *FileData) {
     u8 *FileBase = (u8 *) FileData;
@@ -206,13 +928,23 @@ animation *LoadAnimation(memory_arena *Arena, void *FileData) {
     float *PercentPos = (float *) (FileBase + PercentStart);
     float *DataPos = (float *) (FileBase + DataStart);
 
-    animation *Anim = ArenaAllocT(Arena, animation);
+    animation *Anim = ArenaAllocZeroT(Arena, animation);
     Anim->Duration = *(f32*)FilePos;
     FilePos += sizeof(f32);
     Anim->AnimatedBoneCount = *(u16*)FilePos;
-    FilePos += sizeof(u16) * 2; // pad here to align
+    FilePos += sizeof(u16);
+    Anim->Flags = *(u16*)FilePos;
+    FilePos += sizeof(u16);
+    // uniform animations have no percentages
+    bool HasPercentages = !(Anim->Flags & ANIMATION_FLAG_UNIFORM);
 
-    Anim->Bones = ArenaAllocTN(Arena, bone_animation, Anim->AnimatedBoneCount);
+    if (Anim->Flags & ANIMATION_FLAG_QUANTIZED) {
+        LoadQuantizedBones(Arena, Anim, FilePos, HasPercentages ? PercentPos : 0,
+                           (packed_key *) (FileBase + DataStart));
+        return Anim;
+    }
+
+    Anim->Bones = ArenaAllocZeroTN(Arena, bone_animation, Anim->AnimatedBoneCount);
     for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
         bone_animation *Bone = Anim->Bones + BoneIndex;
         struct {
@@ -228,24 +960,30 @@ animation *LoadAnimation(memory_arena *Arena, void *FileData) {
         Bone->Translations.KeyframeCount = BoneData.TranslationCount;
         if (BoneData.TranslationCount) {
             Bone->ChannelFlags |= CHANNEL_FLAG_TRANSLATION;
-            Bone->Translations.Percentages = PercentPos;
-            PercentPos += BoneData.TranslationCount;
+            if (HasPercentages) {
+                Bone->Translations.Percentages = PercentPos;
+                PercentPos += BoneData.TranslationCount;
+            }
             Bone->Translations.Values = (vec3 *) DataPos;
             DataPos += BoneData.TranslationCount * 3;
         }
         Bone->Rotations.KeyframeCount = BoneData.RotationCount;
         if (BoneData.RotationCount) {
             Bone->ChannelFlags |= CHANNEL_FLAG_ROTATION;
-            Bone->Rotations.Percentages = PercentPos;
-            PercentPos += BoneData.RotationCount;
+            if (HasPercentages) {
+                Bone->Rotations.Percentages = PercentPos;
+                PercentPos += BoneData.RotationCount;
+            }
             Bone->Rotations.Values = (quat *) DataPos;
             DataPos += BoneData.RotationCount * 4;
         }
         Bone->Scales.KeyframeCount = BoneData.ScaleCount;
         if (BoneData.ScaleCount) {
             Bone->ChannelFlags |= CHANNEL_FLAG_SCALE;
-            Bone->Scales.Percentages = PercentPos;
-            PercentPos += BoneData.ScaleCount;
+            if (HasPercentages) {
+                Bone->Scales.Percentages = PercentPos;
+                PercentPos += BoneData.ScaleCount;
+            }
             Bone->Scales.Values = (vec3 *) DataPos;
             DataPos += BoneData.ScaleCount * 3;
         }
@@ -282,3 +1020,128 @@ animation *LoadAnimation(memory_arena *Arena, void *FileData) {
 
     return Anim;
 }
+
+// Set this to run BenchmarkSampling at startup, e.g. with --headless 1.
+// Otherwise it runs from a button in the options pane.
+#ifndef SAMPLING_BENCHMARK
+#define SAMPLING_BENCHMARK 0
+#endif
+
+/** Plays every clip at 60fps for a few loops, sampling each frame
+ *  with SetAnimationToPercentSearch and then SetAnimationToPercent,
+ *  and prints how long each took.  Also checks that they agree.
+ *  Uniform clips can't be searched, so they're timed separately.
+ *  Quantized clips compare the batched decoder against decoding
+ *  each track on its own.  Clobbers Skel's local transforms and
+ *  cursors. */
+static
+void BenchmarkSampling(skeleton *Skel, dais_listing *Clips) {
+    const f32 FrameTime = 1.0f / 60.0f;
+    const f32 Loops = 3;
+    u64 SearchTime = 0;
+    u64 CursorTime = 0;
+    u64 TrackSamples = 0;
+    u64 UniformTime = 0;
+    u64 UniformSamples = 0;
+    u32 UniformClips = 0;
+    u64 QuantizedReferenceTime = 0;
+    u64 QuantizedTime = 0;
+    u64 QuantizedSamples = 0;
+    u32 QuantizedClips = 0;
+    u32 QuantizedMismatches = 0;
+    u32 Mismatches = 0;
+    u32 BoneCount = Skel->Pose.BoneCount;
+    for (s32 ClipIndex = 0; ClipIndex < Clips->Count; ClipIndex++) {
+        arena_temp Temp = ArenaBeginTemp(TempArena);
+        dais_file File = PlatformRef->LoadFileBuffer(TCat("../Avatar/Animations/", Clips->Names[ClipIndex]));
+        if (File.Handle == DAIS_BAD_FILE) {
+            ArenaEndTemp(Temp);
+            continue;
+        }
+        animation *Anim = LoadAnimation(TempArena, File.Data);
+        transform *Expected = ArenaAllocTN(TempArena, transform, BoneCount);
+        bool Uniform = Anim->Flags & ANIMATION_FLAG_UNIFORM;
+        bool Quantized = Anim->Flags & ANIMATION_FLAG_QUANTIZED;
+
+        u32 TrackCount = 0;
+        for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+            u32 Flags = Quantized ? Anim->QuantizedBones[BoneIndex].ChannelFlags : Anim->Bones[BoneIndex].ChannelFlags;
+            TrackCount += !!(Flags & CHANNEL_FLAG_TRANSLATION) +
+                !!(Flags & CHANNEL_FLAG_ROTATION) + !!(Flags & CHANNEL_FLAG_SCALE);
+        }
+
+        memset(Skel->KeyCursors, 0, 3 * BoneCount * sizeof(u32));
+        u32 FrameCount = (u32) (Loops * Anim->Duration / FrameTime);
+        for (u32 Frame = 0; Frame < FrameCount; Frame++) {
+            f32 Percent = fmodf(Frame * FrameTime, Anim->Duration) / Anim->Duration;
+
+            if (Quantized) {
+                u64 Start = PlatformRef->ReadPerformanceCounter();
+                SetQuantizedAnimationToPercentReference(Skel, Anim, Percent);
+                u64 End = PlatformRef->ReadPerformanceCounter();
+                QuantizedReferenceTime += End - Start;
+                CopyTransforms(Expected, Skel->LocalTransforms, BoneCount);
+
+                Start = PlatformRef->ReadPerformanceCounter();
+                SetAnimationToPercent(Skel, Anim, Percent);
+                End = PlatformRef->ReadPerformanceCounter();
+                QuantizedTime += End - Start;
+                if (memcmp(Expected, Skel->LocalTransforms, BoneCount * sizeof(transform)) != 0) {
+                    QuantizedMismatches++;
+                }
+                continue;
+            }
+
+            if (Uniform) {
+                u64 Start = PlatformRef->ReadPerformanceCounter();
+                SetAnimationToPercent(Skel, Anim, Percent);
+                u64 End = PlatformRef->ReadPerformanceCounter();
+                UniformTime += End - Start;
+                continue;
+            }
+
+            u64 Start = PlatformRef->ReadPerformanceCounter();
+            SetAnimationToPercentSearch(Skel, Anim, Percent);
+            u64 End = PlatformRef->ReadPerformanceCounter();
+            SearchTime += End - Start;
+            CopyTransforms(Expected, Skel->LocalTransforms, BoneCount);
+
+            Start = PlatformRef->ReadPerformanceCounter();
+            SetAnimationToPercent(Skel, Anim, Percent);
+            End = PlatformRef->ReadPerformanceCounter();
+            CursorTime += End - Start;
+            if (memcmp(Expected, Skel->LocalTransforms, BoneCount * sizeof(transform)) != 0) {
+                Mismatches++;
+            }
+        }
+        if (Quantized) {
+            QuantizedSamples += (u64) FrameCount * TrackCount;
+            QuantizedClips++;
+        } else if (Uniform) {
+            UniformSamples += (u64) FrameCount * TrackCount;
+            UniformClips++;
+        } else {
+            TrackSamples += (u64) FrameCount * TrackCount;
+        }
+
+        PlatformRef->FreeFileBuffer(File.Handle);
+        ArenaEndTemp(Temp);
+    }
+
+    if (TrackSamples) {
+        printf("Sampled %llu tracks over %d clips\n", (unsigned long long) TrackSamples, Clips->Count - UniformClips - QuantizedClips);
+        printf("  search: %6.2fnS per track\n", (f64) SearchTime / TrackSamples);
+        printf("  cursor: %6.2fnS per track\n", (f64) CursorTime / TrackSamples);
+        printf("  %.2fx faster, %u mismatched frames\n", (f64) SearchTime / CursorTime, Mismatches);
+    }
+    if (UniformSamples) {
+        printf("Sampled %llu tracks over %u uniform clips\n", (unsigned long long) UniformSamples, UniformClips);
+        printf("  uniform: %6.2fnS per track\n", (f64) UniformTime / UniformSamples);
+    }
+    if (QuantizedSamples) {
+        printf("Sampled %llu tracks over %u quantized clips\n", (unsigned long long) QuantizedSamples, QuantizedClips);
+        printf("  one at a time: %6.2fnS per track\n", (f64) QuantizedReferenceTime / QuantizedSamples);
+        printf("  batched:       %6.2fnS per track\n", (f64) QuantizedTime / QuantizedSamples);
+        printf("  %.2fx faster, %u mismatched frames\n", (f64) QuantizedReferenceTime / QuantizedTime, QuantizedMismatches);
+    }
+}
@@ -0,0 +1,226 @@
+// Keeps recently used animation clips loaded, so switching back
+// to a clip costs no I/O.  Each slot owns a slice of reserved
+// memory with its own arena, which holds the clip's file and
+// its runtime structs.  Evicting a clip clears its slot's arena.
+
+#define ANIM_CACHE_SLOTS 16
+// Reserved for each slot, and committed only as clips use it.
+// Clips bigger than this fail to load.
+#define ANIM_CACHE_SLOT_SIZE Megabytes(16)
+#define ANIM_CACHE_SIZE (ANIM_CACHE_SLOTS * ANIM_CACHE_SLOT_SIZE)
+// Least recently used clips are evicted to keep
+// the total size of loaded clips under this.
+#define ANIM_CACHE_BUDGET Megabytes(16)
+
+#define ANIM_SLOT_FREE    0
+#define ANIM_SLOT_LOADING 1
+#define ANIM_SLOT_LOADED  2
+#define ANIM_SLOT_FAILED  3
+
+/** Names a clip in the cache.  The generation in the high bits
+ *  goes stale when the clip is evicted, so old handles miss
+ *  instead of finding whatever was loaded in their place.
+ *  Zero is never a valid handle. */
+typedef u32 anim_handle;
+
+struct anim_slot {
+    memory_arena Arena;
+    u32 State;
+    u32 Generation;
+    // points into the animations listing, which outlives the cache
+    const char *Name;
+    dais_io_ticket Ticket;
+    u64 LastUsed;
+    animation *Anim;
+};
+
+struct anim_cache {
+    anim_slot Slots[ANIM_CACHE_SLOTS];
+    // advances every frame, for LRU eviction
+    u64 Frame;
+    u64 Hits;
+    u64 Misses;
+};
+
+static
+void InitAnimationCache(anim_cache *Cache, char *Memory) {
+    for (u32 Index = 0; Index < ANIM_CACHE_SLOTS; Index++) {
+        anim_slot *Slot = Cache->Slots + Index;
+        ArenaInit(&Slot->Arena, Memory + Index * ANIM_CACHE_SLOT_SIZE, ANIM_CACHE_SLOT_SIZE);
+        Slot->State = ANIM_SLOT_FREE;
+        Slot->Generation = 1;
+    }
+}
+
+static inline
+anim_handle AnimHandleForSlot(anim_cache *Cache, anim_slot *Slot) {
+    return (Slot->Generation << 8) | (u32) (Slot - Cache->Slots);
+}
+
+static inline
+anim_slot *AnimSlotForHandle(anim_cache *Cache, anim_handle Handle) {
+    if (!Handle) return 0;
+    anim_slot *Slot = Cache->Slots + (Handle & 0xFF);
+    return (Slot->Generation == (Handle >> 8)) ? Slot : 0;
+}
+
+static
+void EvictAnimation(anim_slot *Slot) {
+    Assert(Slot->State != ANIM_SLOT_LOADING); // the read still owns the memory
+    printf("Evicting animation %s\n", Slot->Name);
+    ArenaClear(&Slot->Arena);
+    Slot->State = ANIM_SLOT_FREE;
+    Slot->Generation++;
+    Slot->Name = 0;
+    Slot->Anim = 0;
+}
+
+// Finds the least recently used clip that can be evicted.
+// Clips used in the current or last frame are never picked,
+// so the clip that's playing stays put.
+static
+anim_slot *FindEvictableSlot(anim_cache *Cache) {
+    anim_slot *Oldest = 0;
+    for (u32 Index = 0; Index < ANIM_CACHE_SLOTS; Index++) {
+        anim_slot *Slot = Cache->Slots + Index;
+        if (Slot->State == ANIM_SLOT_FREE || Slot->State == ANIM_SLOT_LOADING) continue;
+        if (Slot->LastUsed + 1 >= Cache->Frame) continue;
+        if (!Oldest || Slot->LastUsed < Oldest->LastUsed) Oldest = Slot;
+    }
+    return Oldest;
+}
+
+static
+anim_slot *FindFreeSlot(anim_cache *Cache) {
+    for (u32 Index = 0; Index < ANIM_CACHE_SLOTS; Index++) {
+        anim_slot *Slot = Cache->Slots + Index;
+        if (Slot->State == ANIM_SLOT_FREE) return Slot;
+    }
+    anim_slot *Slot = FindEvictableSlot(Cache);
+    if (Slot) EvictAnimation(Slot);
+    return Slot;
+}
+
+static
+u64 AnimationCacheBytes(anim_cache *Cache) {
+    u64 Total = 0;
+    for (u32 Index = 0; Index < ANIM_CACHE_SLOTS; Index++) {
+        Total += Cache->Slots[Index].Arena.Pos;
+    }
+    return Total;
+}
+
+static
+u64 AnimationCacheCommitted(anim_cache *Cache) {
+    u64 Total = 0;
+    for (u32 Index = 0; Index < ANIM_CACHE_SLOTS; Index++) {
+        Total += Cache->Slots[Index].Arena.Committed;
+    }
+    return Total;
+}
+
+/** Returns a handle to the named clip, starting a background
+ *  load if it isn't cached.  Name must outlive the cache. */
+static
+anim_handle RequestAnimation(anim_cache *Cache, const char *Name) {
+    for (u32 Index = 0; Index < ANIM_CACHE_SLOTS; Index++) {
+        anim_slot *Slot = Cache->Slots + Index;
+        if (Slot->State != ANIM_SLOT_FREE && strcmp(Slot->Name, Name) == 0) {
+            // try failed loads again
+            if (Slot->State == ANIM_SLOT_FAILED) {
+                EvictAnimation(Slot);
+                break;
+            }
+            Cache->Hits++;
+            Slot->LastUsed = Cache->Frame;
+            return AnimHandleForSlot(Cache, Slot);
+        }
+    }
+
+    Cache->Misses++;
+    anim_slot *Slot = FindFreeSlot(Cache);
+    if (!Slot) {
+        printf("No room to load animation %s\n", Name);
+        return 0;
+    }
+
+    printf("Loading %s\n", Name);
+    dais_io_request Request = {};
+    Request.Filename = TCat("../Avatar/Animations/", Name);
+    Request.Arena = &Slot->Arena;
+    PlatformRef->SubmitFileReads(&Request, &Slot->Ticket, 1);
+
+    Slot->State = ANIM_SLOT_LOADING;
+    Slot->Name = Name;
+    Slot->LastUsed = Cache->Frame;
+    return AnimHandleForSlot(Cache, Slot);
+}
+
+static
+void FinishAnimationLoad(anim_cache *Cache, anim_slot *Slot, s32 Status, dais_file *File) {
+    Slot->Ticket = 0;
+    if (Status == DAIS_IO_COMPLETE) {
+        Slot->Anim = LoadAnimation(&Slot->Arena, File->Data);
+        Slot->State = ANIM_SLOT_LOADED;
+        // don't evict it before the requester picks it up
+        Slot->LastUsed = Cache->Frame;
+    } else {
+        printf("Failed to load animation %s.\n", Slot->Name);
+        Slot->State = ANIM_SLOT_FAILED;
+    }
+}
+
+/** Blocks until the clip has finished loading. */
+static
+void WaitForAnimation(anim_cache *Cache, anim_handle Handle) {
+    anim_slot *Slot = AnimSlotForHandle(Cache, Handle);
+    if (Slot && Slot->State == ANIM_SLOT_LOADING) {
+        dais_file File;
+        s32 Status = PlatformRef->WaitFileRead(Slot->Ticket, &File);
+        FinishAnimationLoad(Cache, Slot, Status, &File);
+    }
+}
+
+/** Call once per frame.  Finishes background loads, then
+ *  evicts old clips until the cache is under budget. */
+static
+void UpdateAnimationCache(anim_cache *Cache) {
+    Cache->Frame++;
+    for (u32 Index = 0; Index < ANIM_CACHE_SLOTS; Index++) {
+        anim_slot *Slot = Cache->Slots + Index;
+        if (Slot->State == ANIM_SLOT_LOADING) {
+            dais_file File;
+            s32 Status = PlatformRef->PollFileRead(Slot->Ticket, &File);
+            if (Status != DAIS_IO_PENDING) {
+                FinishAnimationLoad(Cache, Slot, Status, &File);
+            }
+        }
+    }
+
+    while (AnimationCacheBytes(Cache) > ANIM_CACHE_BUDGET) {
+        anim_slot *Slot = FindEvictableSlot(Cache);
+        if (!Slot) break;
+        EvictAnimation(Slot);
+    }
+}
+
+/** Returns DAIS_IO_PENDING while the clip loads, then DAIS_IO_COMPLETE
+ *  or DAIS_IO_FAILED.  Evicted clips count as failed. */
+static
+s32 AnimationStatus(anim_cache *Cache, anim_handle Handle) {
+    anim_slot *Slot = AnimSlotForHandle(Cache, Handle);
+    if (!Slot || Slot->State == ANIM_SLOT_FREE || Slot->State == ANIM_SLOT_FAILED) {
+        return DAIS_IO_FAILED;
+    }
+    return Slot->State == ANIM_SLOT_LOADING ? DAIS_IO_PENDING : DAIS_IO_COMPLETE;
+}
+
+/** Returns the clip if it's loaded, or 0.  Counts as a use,
+ *  so call it every frame for clips that should stay cached. */
+static
+animation *GetAnimation(anim_cache *Cache, anim_handle Handle) {
+    anim_slot *Slot = AnimSlotForHandle(Cache, Handle);
+    if (!Slot || Slot->State != ANIM_SLOT_LOADED) return 0;
+    Slot->LastUsed = Cache->Frame;
+    return Slot->Anim;
+}
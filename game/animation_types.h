@@ -8,6 +8,14 @@
 #define CHANNEL_FLAG_ROTATION (1<<1)
 #define CHANNEL_FLAG_SCALE (1<<2)
 
+// Every track has one key, or keys evenly spaced from the start of
+// the clip to the end.  Timelines have no Percentages.
+#define ANIMATION_FLAG_UNIFORM (1<<0)
+// Keys are packed_keys instead of floats, and bones are in
+// QuantizedBones instead of Bones.  The last key is followed by
+// padding, see LoadKeyPairs.
+#define ANIMATION_FLAG_QUANTIZED (1<<1)
+
 struct transform {
     vec3 Translation;
     quat Rotation;
@@ -17,7 +25,7 @@ struct transform {
 template <typename pt>
 struct timeline {
     u32 KeyframeCount;
-    // sorted ASC
+    // sorted ASC, null in uniform animations
     f32 *Percentages;
     // index matches Percentages
     pt *Values;
@@ -31,11 +39,37 @@ struct bone_animation {
     timeline<vec3> Scales;
 };
 
+// A key in a quantized animation.  Vectors are Min + Scale * Data
+// with the track's bounds.  Rotations are smallest three: the three
+// smallest components in the low 15 bits of each, and the index of
+// the largest in the top bits of the first two.  See DecodeQuatKey.
+struct packed_key {
+    u16 Data[3];
+};
+
+struct track_bounds {
+    vec3 Min;
+    vec3 Scale;
+};
+
+struct quantized_bone_animation {
+    u16 BoneID;
+    u16 ChannelFlags;
+    timeline<packed_key> Translations;
+    timeline<packed_key> Rotations;
+    timeline<packed_key> Scales;
+    track_bounds TranslationBounds;
+    track_bounds ScaleBounds;
+};
+
 struct animation {
     f32 Duration;
     u16 AnimatedBoneCount;
-    // sorted by BoneID ASC
+    u16 Flags;
+    // sorted by BoneID ASC, null in quantized animations
     bone_animation *Bones;
+    // sorted by BoneID ASC, only in quantized animations
+    quantized_bone_animation *QuantizedBones;
 };
 
 struct skeleton_pose {
@@ -45,6 +79,8 @@ struct skeleton_pose {
     transform *SetupPose;
 };
 
+// The setup matrices are baked once by InitSkeleton,
+// the rest are updated every frame.
 struct skeleton {
     skeleton_pose Pose;
     mat4x3 *LocalSetupMatrices;
@@ -54,8 +90,13 @@ struct skeleton {
     transform *LocalTransforms;
     mat4x3 *LocalOffsets;
     mat4x3 *LocalMatrices;
-    mat4x3 *CompositeMatrices;
     mat4x3 *WorldMatrices;
+    // posed transforms in model space,
+    // only used by UpdateMatricesFromTransformsQV
+    transform *WorldTransforms;
+    // the last key sampled in each track, three per animated
+    // bone, see LookupWithCursor
+    u32 *KeyCursors;
 };
 
 struct skinned_mesh_mesh {
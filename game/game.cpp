@@ -15,6 +15,10 @@
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "../imgui/imgui.h"
 #include "../imgui/imgui_demo.cpp"
 
@@ -49,23 +53,46 @@ dais *PlatformRef;
 state *State;
 memory_arena *TempArena;
 memory_arena *PermArena;
+memory_arena *ScratchArenas;
+
+// Each job thread has its own scratch arena, so jobs can
+// allocate temporary memory without synchronizing.
+// Like TempArena, these are cleared at the end of each frame.
+// Results that must outlive a job can go in TempArena
+// through ArenaAllocAtomic.
+// There is one for every thread dais could ever run, not just
+// this machine's, so recordings replay on machines with more
+// threads.  The unused ones are only reserved.
+static inline
+memory_arena *ScratchArena(u32 ThreadIndex) {
+    Assert(ThreadIndex < DAIS_MAX_JOB_THREADS);
+    return ScratchArenas + ThreadIndex;
+}
 
 // -------- Source Files --------
 
 #include "strings.cpp"
 #include "animation_types.h"
+#include "matrix_kernels.cpp"
 #include "animation.cpp"
+#include "animation_cache.cpp"
 #include "render.cpp"
 
 struct state {
-    u32 TempArenaMaxSize;
+    u64 TempArenaMaxSize;
     memory_arena TempArena;
     memory_arena GameArena;
+    // DAIS_MAX_JOB_THREADS of them, allocated from GameArena
+    memory_arena *ScratchArenas;
     dais_file SkeletonFile;
-    dais_file AnimFile;
+    anim_cache *AnimCache;
+    // the clip that's playing, and the one to switch to once it loads
+    anim_handle AnimHandle;
+    anim_handle PendingAnimHandle;
 
     floor_grid Grid;
     skinned_mesh *SkinnedMesh;
+    skeleton *Skeleton;
     // use a pointer so we can hotswap a size change
     shader_state *ShaderState;
 
@@ -89,44 +116,139 @@ struct state {
     float ViewEnd;
 
     bool TestLoop;
+    // walk the bone hierarchy with transforms instead of matrices
+    bool TransformHierarchy;
     bool RenderSkeleton;
     bool RenderGrid;
     bool ShowImguiTestWindow;
+    bool ShowAllocations;
 };
 
 #define TEMP_MEM_SIZE Megabytes(2)
 #define GAME_OFFSET Kilobytes(4)
 
+// GetMemoryUsage walks every page of game memory, so the
+// Memory section only refreshes it about once a second.
+#define MEMORY_USAGE_REFRESH_NS 1000000000ULL
+static dais_memory_usage MemoryUsage;
+static u64 MemoryUsageTime;
+
 #define PERF_STAT(NAME) \
-    dais_perf_stat NAME##Stat__ (PlatformRef, #NAME)
+    static u32 NAME##StatID__ = 0; \
+    dais_perf_stat NAME##Stat__ (PlatformRef, &NAME##StatID__, #NAME)
 #define PERF_END(NAME) \
     NAME##Stat__.end()
 
+// Starts loading the current animation in the background.
+// The previous animation keeps playing until it arrives.
 static
 void LoadNextAnimation() {
     printf("Loading next animation (id %d)\n", State->CurrentAnimation);
     char *Animation = State->AnimationsList.Names[State->CurrentAnimation];
-    char *Filename = TCat("../Avatar/Animations/", Animation);
-    if (State->AnimFile.Data) {
-        printf("Unloading old animation\n");
-        PlatformRef->UnmapReadOnlyFile(State->AnimFile.Handle);
+    State->PendingAnimHandle = RequestAnimation(State->AnimCache, Animation);
+}
+
+static
+void PollAnimationLoad() {
+    UpdateAnimationCache(State->AnimCache);
+    if (State->PendingAnimHandle) {
+        s32 Status = AnimationStatus(State->AnimCache, State->PendingAnimHandle);
+        if (Status == DAIS_IO_FAILED) {
+            printf("Failed to load animation.\n");
+            exit(-1);
+        } else if (Status == DAIS_IO_COMPLETE) {
+            State->AnimHandle = State->PendingAnimHandle;
+            State->PendingAnimHandle = 0;
+            animation *Anim = GetAnimation(State->AnimCache, State->AnimHandle);
+            State->AnimTime = 0;
+            State->ClipStart = 0;
+            State->ClipEnd = Anim->Duration;
+            State->ViewStart = 0;
+            State->ViewEnd = Anim->Duration;
+        }
     }
+    // the playing clip is used every frame, so it's never evicted
+    State->Anim = GetAnimation(State->AnimCache, State->AnimHandle);
+}
 
-    printf("Loading %s\n", Animation);
-    State->AnimFile = PlatformRef->MapReadOnlyFile(Filename);
-    if (State->AnimFile.Handle == DAIS_BAD_FILE) {
-        printf("Failed to load animation.\n");
-        exit(-1);
-    } else {
-        State->Anim = LoadAnimation(PermArena, State->AnimFile.Data);
-        State->AnimTime = 0;
-        State->ClipStart = 0;
-        State->ClipEnd = State->Anim->Duration;
-        State->ViewStart = 0;
-        State->ViewEnd = State->Anim->Duration;
+// The memory the game's arenas have committed, plus the page
+// the state lives in.
+static
+u64 CommittedArenaBytes() {
+    u64 Total = GAME_OFFSET + State->TempArena.Committed + State->GameArena.Committed;
+    for (u32 Index = 0; Index < DAIS_MAX_JOB_THREADS; Index++) {
+        Total += State->ScratchArenas[Index].Committed;
+    }
+    return Total + AnimationCacheCommitted(State->AnimCache);
+}
+
+#if ARENA_TRACKING
+
+static
+const char *ArenaName(memory_arena *Arena) {
+    if (Arena == TempArena) return "Temp";
+    if (Arena == PermArena) return "Perm";
+    if (Arena >= ScratchArenas && Arena < ScratchArenas + DAIS_MAX_JOB_THREADS) {
+        return TPrintf("Scratch %u", (u32) (Arena - ScratchArenas));
+    }
+    return TPrintf("%p", Arena);
+}
+
+static
+int CompareAllocSites(const void *A, const void *B) {
+    const arena_alloc_site *SiteA = *(const arena_alloc_site **) A;
+    const arena_alloc_site *SiteB = *(const arena_alloc_site **) B;
+    if (SiteA->LastFrameBytes != SiteB->LastFrameBytes) {
+        return SiteA->LastFrameBytes > SiteB->LastFrameBytes ? -1 : 1;
+    }
+    if (SiteA->TotalBytes != SiteB->TotalBytes) {
+        return SiteA->TotalBytes > SiteB->TotalBytes ? -1 : 1;
     }
+    return 0;
 }
 
+// Lists arena allocations by call site, heaviest
+// in the last frame first, then heaviest overall.
+static
+void ShowAllocationsWindow(bool *Open) {
+    if (!ImGui::Begin("Allocations", Open)) {
+        ImGui::End();
+        return;
+    }
+
+    arena_alloc_site *Sites;
+    u32 SiteCount = ArenaGetAllocSites(&Sites);
+    arena_alloc_site **Sorted = ArenaAllocTN(TempArena, arena_alloc_site *, SiteCount);
+    for (u32 Index = 0; Index < SiteCount; Index++) {
+        Sorted[Index] = Sites + Index;
+    }
+    qsort(Sorted, SiteCount, sizeof(*Sorted), CompareAllocSites);
+
+    ImGui::Columns(6, "AllocSites");
+    ImGui::Text("Site"); ImGui::NextColumn();
+    ImGui::Text("Arena"); ImGui::NextColumn();
+    ImGui::Text("Frame Bytes"); ImGui::NextColumn();
+    ImGui::Text("Frame Allocs"); ImGui::NextColumn();
+    ImGui::Text("Total Bytes"); ImGui::NextColumn();
+    ImGui::Text("Total Allocs"); ImGui::NextColumn();
+    ImGui::Separator();
+    for (u32 Index = 0; Index < SiteCount; Index++) {
+        arena_alloc_site *Site = Sorted[Index];
+        const char *File = strrchr(Site->File, '/');
+        File = File ? File + 1 : Site->File;
+        ImGui::Text("%s:%u", File, Site->Line); ImGui::NextColumn();
+        ImGui::Text("%s", Site->Arena ? ArenaName(Site->Arena) : ""); ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long) Site->LastFrameBytes); ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long) Site->LastFrameCount); ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long) Site->TotalBytes); ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long) Site->TotalCount); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::End();
+}
+
+#endif
+
 extern "C"
 DAIS_UPDATE_AND_RENDER(GameUpdate) {
     Assert(GAME_OFFSET > sizeof(state));
@@ -136,12 +258,32 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
     TempArena = &State->TempArena;
     PermArena = &State->GameArena;
     PlatformRef = Platform;
+    ArenaCommitMemory = Platform->CommitMemory;
+    ArenaDecommitMemory = Platform->DecommitMemory;
 
     PERF_STAT(Frame);
 
     if (!Platform->Initialized) {
-        ArenaInit(&State->TempArena, Platform->Memory + (Platform->MemorySize - TEMP_MEM_SIZE), TEMP_MEM_SIZE);
-        ArenaInit(&State->GameArena, Platform->Memory + GAME_OFFSET, Platform->MemorySize - TEMP_MEM_SIZE - 2*GAME_OFFSET);
+        Platform->CommitMemory(Platform->Memory, GAME_OFFSET);
+        // the scratch arenas sit just below the temp arena,
+        // and the animation cache just below them
+        u32 ScratchCount = DAIS_MAX_JOB_THREADS;
+        u64 ScratchSize = ScratchCount * TEMP_MEM_SIZE;
+        char *TempBase = Platform->Memory + (Platform->MemorySize - TEMP_MEM_SIZE);
+        char *ScratchBase = TempBase - ScratchSize;
+        char *AnimCacheBase = ScratchBase - ANIM_CACHE_SIZE;
+        ArenaInit(&State->TempArena, TempBase, TEMP_MEM_SIZE);
+        ArenaInit(&State->GameArena, Platform->Memory + GAME_OFFSET, Platform->MemorySize - TEMP_MEM_SIZE - ScratchSize - ANIM_CACHE_SIZE - 2*GAME_OFFSET);
+
+        State->ScratchArenas = ArenaAllocTN(&State->GameArena, memory_arena, ScratchCount);
+        for (u32 Index = 0; Index < ScratchCount; Index++) {
+            ArenaInit(State->ScratchArenas + Index, ScratchBase + Index * TEMP_MEM_SIZE, TEMP_MEM_SIZE);
+        }
+        // loading below may already run jobs
+        ScratchArenas = State->ScratchArenas;
+
+        State->AnimCache = ArenaAllocZeroT(&State->GameArena, anim_cache);
+        InitAnimationCache(State->AnimCache, AnimCacheBase);
         Platform->Initialized = true;
 
         State->SkeletonFile = Platform->MapReadOnlyFile("../Avatar/DefaultAvatar.skm");
@@ -152,6 +294,7 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
             printf("Loaded default avatar, %u bytes at %p.\n", State->SkeletonFile.Size, State->SkeletonFile.Data);
             State->SkinnedMesh = LoadMeshData(&State->GameArena, State->SkeletonFile.Data);
             UploadMeshesToOGL(State->SkinnedMesh);
+            State->Skeleton = InitSkeleton(&State->GameArena, State->SkinnedMesh->BindPose);
         }
 
         InitFloorGrid(&State->Grid);
@@ -161,10 +304,21 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
         State->AnimSpeed = 1.0f;
 
         State->RenderGrid = true;
+        State->TransformHierarchy = true;
+
+#if SAMPLING_BENCHMARK
+        BenchmarkSampling(State->Skeleton, &State->AnimationsList);
+#endif
 
+        // there's nothing to play until the first animation arrives
         LoadNextAnimation();
+        WaitForAnimation(State->AnimCache, State->PendingAnimHandle);
     }
 
+    ScratchArenas = State->ScratchArenas;
+
+    PollAnimationLoad();
+
     if (Platform->JustReloaded) {
         State->ShaderState = InitShaders(&State->GameArena);
     }
@@ -177,6 +331,11 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
     if (State->ShowImguiTestWindow) {
         ImGui::ShowDemoWindow(&State->ShowImguiTestWindow);
     }
+#if ARENA_TRACKING
+    if (State->ShowAllocations) {
+        ShowAllocationsWindow(&State->ShowAllocations);
+    }
+#endif
 
     // options
     float OptionsWidth = Input->WindowWidth * 0.2f;
@@ -227,8 +386,31 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
     ImGui::Checkbox("Test Loop", &State->TestLoop);
     ImGui::Checkbox("Render Grid", &State->RenderGrid);
     ImGui::Checkbox("Render Skeleton", &State->RenderSkeleton);
+    ImGui::Checkbox("Transform Hierarchy", &State->TransformHierarchy);
 
     ImGui::Checkbox("Show ImGui Test Window", &State->ShowImguiTestWindow);
+    if (ImGui::Button("Benchmark Sampling")) {
+        BenchmarkSampling(State->Skeleton, &State->AnimationsList);
+    }
+#if ARENA_TRACKING
+    ImGui::Checkbox("Show Allocations", &State->ShowAllocations);
+#endif
+
+    if (ImGui::CollapsingHeader("Memory")) {
+        if (ImGui::Button("Refresh") || !MemoryUsageTime ||
+                Input->UpTimeNS - MemoryUsageTime > MEMORY_USAGE_REFRESH_NS) {
+            MemoryUsage = Platform->GetMemoryUsage();
+            MemoryUsageTime = Input->UpTimeNS;
+        }
+        ImGui::Text("Reserved:   %8.1f MB", MemoryUsage.Reserved / (f64) Megabytes(1));
+        ImGui::Text("Committed:  %8.1f MB", CommittedArenaBytes() / (f64) Megabytes(1));
+        ImGui::Text("Resident:   %8.1f MB", MemoryUsage.Resident / (f64) Megabytes(1));
+        ImGui::Text("Huge Pages: %8.1f MB", MemoryUsage.HugePages / (f64) Megabytes(1));
+        ImGui::Text("Game Arena: %8.1f MB", State->GameArena.Pos / (f64) Megabytes(1));
+        ImGui::Text("Animations: %8.1f MB", AnimationCacheBytes(State->AnimCache) / (f64) Megabytes(1));
+        ImGui::Text("Animation Cache: %llu hits, %llu misses",
+                    (unsigned long long) State->AnimCache->Hits, (unsigned long long) State->AnimCache->Misses);
+    }
     ImGui::End();
 
     // timeline
@@ -303,45 +485,32 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
     // --------- Animation ---------
 
     PERF_STAT(Animation);
-    skeleton Skel;
-    PERF_STAT(AnimationBake);
-    Skel.Pose = State->SkinnedMesh->BindPose;
-    Skel.LocalSetupMatrices = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
-    Skel.InverseLocalSetupMatrices = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
-    Skel.WorldSetupMatrices = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
-    Skel.InverseSetupMatrices = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
-    UpdateSetupMatrices(&Skel);
-
-    Skel.LocalTransforms = ArenaAllocTN(TempArena, transform, Skel.Pose.BoneCount);
-    for (u32 Index = 0; Index < Skel.Pose.BoneCount; Index++) {
-        Skel.LocalTransforms[Index] = Skel.Pose.SetupPose[Index];
-    }
-    PERF_END(AnimationBake);
-
-    SetAnimationToPercent(&Skel, State->Anim, AnimPercent);
+    skeleton *Skel = State->Skeleton;
+    ResetToSetupPose(Skel);
+    SetAnimationToPercent(Skel, State->Anim, AnimPercent);
 
-    // Skel.LocalTransforms[32].Rotation = Skel.LocalTransforms[32].Rotation *
+    // Skel->LocalTransforms[32].Rotation = Skel->LocalTransforms[32].Rotation *
     //     glm::angleAxis(
     //         State->Angle,
     //         glm::normalize(vec3(1,1,-1)));
-    // Skel.LocalTransforms[33].Rotation = Skel.LocalTransforms[33].Rotation *
+    // Skel->LocalTransforms[33].Rotation = Skel->LocalTransforms[33].Rotation *
     //     glm::angleAxis(
     //         State->Angle,
     //         glm::normalize(vec3(1,1,-1)));
-    // Skel.LocalTransforms[51].Rotation = Skel.LocalTransforms[51].Rotation *
+    // Skel->LocalTransforms[51].Rotation = Skel->LocalTransforms[51].Rotation *
     //     glm::angleAxis(
     //         State->Angle,
     //         glm::normalize(vec3(1,1,1)));
-    // Skel.LocalTransforms[52].Rotation = Skel.LocalTransforms[52].Rotation *
+    // Skel->LocalTransforms[52].Rotation = Skel->LocalTransforms[52].Rotation *
     //     glm::angleAxis(
     //         State->Angle,
     //         glm::normalize(vec3(1,1,1)));
-    Skel.LocalOffsets = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
-    Skel.LocalMatrices = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
-    Skel.CompositeMatrices = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
-    Skel.WorldMatrices = ArenaAllocTN(TempArena, mat4x3, Skel.Pose.BoneCount);
 
-    UpdateMatricesFromTransforms(&Skel);
+    if (State->TransformHierarchy) {
+        UpdateMatricesFromTransformsQV(Skel);
+    } else {
+        UpdateMatricesFromTransforms(Skel);
+    }
     PERF_END(Animation);
 
 
@@ -366,8 +535,8 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
     LookDirection = glm::rotateX(LookDirection, Pitch);
     LookDirection = glm::rotateY(LookDirection, Yaw);
 
-    vec3 LookCenter = Skel.WorldMatrices[2] *
-            vec4(Skel.WorldSetupMatrices[3][3], 1.0f);
+    vec3 LookCenter = Skel->WorldMatrices[2] *
+            vec4(Skel->WorldSetupMatrices[3][3], 1.0f);
     LookCenter.y -= 15;
     vec3 LookSource = LookCenter - LookDirection * Distance;
 
@@ -396,11 +565,11 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
         glDisable(GL_BLEND);
     }
 
-    RenderSkinnedMesh(State->ShaderState, State->SkinnedMesh, &Skel, Combined);
+    RenderSkinnedMesh(State->ShaderState, State->SkinnedMesh, Skel, Combined);
 
     if (State->RenderSkeleton) {
         glDisable(GL_DEPTH_TEST);
-        RenderBones(State->ShaderState, &Skel, Combined);
+        RenderBones(State->ShaderState, Skel, Combined);
     }
 
     PERF_END(Rendering);
@@ -409,9 +578,9 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
 
     PERF_STAT(Cleanup);
     if (State->TempArena.Pos > State->TempArenaMaxSize) {
-        u32 Size = State->TempArena.Pos;
+        u64 Size = State->TempArena.Pos;
         State->TempArenaMaxSize = Size;
-        u32 Megabytes = (Size >> 20) & 0x3FF;
+        u32 Megabytes = (u32) (Size >> 20);
         u32 Kilobytes = (Size >> 10) & 0x3FF;
         u32 Bytes = Size & 0x3FF;
         if (Megabytes > 0) {
@@ -422,7 +591,13 @@ DAIS_UPDATE_AND_RENDER(GameUpdate) {
             printf("New TempArena Max Size: %d\n", Bytes);
         }
     }
+#if ARENA_TRACKING
+    ArenaTrackingEndFrame();
+#endif
     ArenaClear(&State->TempArena);
+    for (u32 Index = 0; Index < DAIS_MAX_JOB_THREADS; Index++) {
+        ArenaClear(ScratchArenas + Index);
+    }
     PERF_END(Cleanup);
 
 }
@@ -0,0 +1,220 @@
+// SSE kernels for the per-bone matrix math in animation.cpp.
+// Each kernel works on four bones at a time.  It loads four
+// bones and transposes them so that each register holds one
+// field for all four (SoA).  The math runs on those registers,
+// then the results are transposed back.  Counts must be a
+// multiple of four.  The callers in animation.cpp run the
+// scalar reference code on the rest, and on other targets.
+
+#if defined(__SSE2__)
+#define MATRIX_KERNELS_SSE 1
+
+// The kernels read these types as packed floats.
+static_assert(sizeof(mat4x3) == 12 * sizeof(f32), "mat4x3 must be 12 packed floats");
+static_assert(sizeof(transform) == 10 * sizeof(f32), "transform must be 10 packed floats");
+
+// Four mat4x3s, one float from each per register.
+// Stored column major like mat4x3, so M[3*Col + Row].
+struct matrix_batch {
+    __m128 M[12];
+};
+
+static inline
+void LoadMatrixBatch(matrix_batch *Batch, const mat4x3 *Matrices) {
+    const f32 *Floats = (const f32 *) Matrices;
+    for (u32 Part = 0; Part < 3; Part++) {
+        __m128 R0 = _mm_loadu_ps(Floats + 0*12 + Part*4);
+        __m128 R1 = _mm_loadu_ps(Floats + 1*12 + Part*4);
+        __m128 R2 = _mm_loadu_ps(Floats + 2*12 + Part*4);
+        __m128 R3 = _mm_loadu_ps(Floats + 3*12 + Part*4);
+        _MM_TRANSPOSE4_PS(R0, R1, R2, R3);
+        Batch->M[Part*4 + 0] = R0;
+        Batch->M[Part*4 + 1] = R1;
+        Batch->M[Part*4 + 2] = R2;
+        Batch->M[Part*4 + 3] = R3;
+    }
+}
+
+static inline
+void StoreMatrixBatch(mat4x3 *Matrices, const matrix_batch *Batch) {
+    f32 *Floats = (f32 *) Matrices;
+    for (u32 Part = 0; Part < 3; Part++) {
+        __m128 R0 = Batch->M[Part*4 + 0];
+        __m128 R1 = Batch->M[Part*4 + 1];
+        __m128 R2 = Batch->M[Part*4 + 2];
+        __m128 R3 = Batch->M[Part*4 + 3];
+        _MM_TRANSPOSE4_PS(R0, R1, R2, R3);
+        _mm_storeu_ps(Floats + 0*12 + Part*4, R0);
+        _mm_storeu_ps(Floats + 1*12 + Part*4, R1);
+        _mm_storeu_ps(Floats + 2*12 + Part*4, R2);
+        _mm_storeu_ps(Floats + 3*12 + Part*4, R3);
+    }
+}
+
+// Affine multiply, treating both as 4x4 with a bottom row of 0 0 0 1.
+static inline
+void MultiplyMatrixBatch(matrix_batch *Result, const matrix_batch *A, const matrix_batch *B) {
+    matrix_batch R;
+    for (u32 Col = 0; Col < 4; Col++) {
+        __m128 X = B->M[3*Col + 0];
+        __m128 Y = B->M[3*Col + 1];
+        __m128 Z = B->M[3*Col + 2];
+        for (u32 Row = 0; Row < 3; Row++) {
+            __m128 Sum = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(A->M[0 + Row], X), _mm_mul_ps(A->M[3 + Row], Y)),
+                _mm_mul_ps(A->M[6 + Row], Z));
+            if (Col == 3) Sum = _mm_add_ps(Sum, A->M[9 + Row]);
+            R.M[3*Col + Row] = Sum;
+        }
+    }
+    *Result = R;
+}
+
+static
+void TransformsToMatricesSSE(mat4x3 * restrict Matrices, transform * restrict Transforms, u32 Count) {
+    Assert(Count % 4 == 0);
+    const __m128 One = _mm_set1_ps(1.0f);
+    const __m128 Two = _mm_set1_ps(2.0f);
+    for (u32 Index = 0; Index < Count; Index += 4) {
+        // load Translation, Rotation (xyzw) and Scale for four bones
+        const f32 *F = (const f32 *) (Transforms + Index);
+        __m128 Tx = _mm_loadu_ps(F + 0);
+        __m128 Ty = _mm_loadu_ps(F + 10);
+        __m128 Tz = _mm_loadu_ps(F + 20);
+        __m128 Qx = _mm_loadu_ps(F + 30);
+        _MM_TRANSPOSE4_PS(Tx, Ty, Tz, Qx);
+        __m128 Qy = _mm_loadu_ps(F + 4);
+        __m128 Qz = _mm_loadu_ps(F + 14);
+        __m128 Qw = _mm_loadu_ps(F + 24);
+        __m128 Sx = _mm_loadu_ps(F + 34);
+        _MM_TRANSPOSE4_PS(Qy, Qz, Qw, Sx);
+        // the last two floats of each transform, without
+        // reading past the end of the last one
+        __m128 S0 = _mm_castpd_ps(_mm_load_sd((const double *) (F + 8)));
+        __m128 S1 = _mm_castpd_ps(_mm_load_sd((const double *) (F + 18)));
+        __m128 S2 = _mm_castpd_ps(_mm_load_sd((const double *) (F + 28)));
+        __m128 S3 = _mm_castpd_ps(_mm_load_sd((const double *) (F + 38)));
+        __m128 Sy = S0, Sz = S1;
+        _MM_TRANSPOSE4_PS(Sy, Sz, S2, S3);
+
+        // same as glm::mat3_cast, scaled per column
+        __m128 X2 = _mm_mul_ps(Qx, Two);
+        __m128 Y2 = _mm_mul_ps(Qy, Two);
+        __m128 Z2 = _mm_mul_ps(Qz, Two);
+        __m128 XX = _mm_mul_ps(Qx, X2);
+        __m128 YY = _mm_mul_ps(Qy, Y2);
+        __m128 ZZ = _mm_mul_ps(Qz, Z2);
+        __m128 XY = _mm_mul_ps(Qx, Y2);
+        __m128 XZ = _mm_mul_ps(Qx, Z2);
+        __m128 YZ = _mm_mul_ps(Qy, Z2);
+        __m128 WX = _mm_mul_ps(Qw, X2);
+        __m128 WY = _mm_mul_ps(Qw, Y2);
+        __m128 WZ = _mm_mul_ps(Qw, Z2);
+
+        matrix_batch Batch;
+        Batch.M[0] = _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(YY, ZZ)), Sx);
+        Batch.M[1] = _mm_mul_ps(_mm_add_ps(XY, WZ), Sx);
+        Batch.M[2] = _mm_mul_ps(_mm_sub_ps(XZ, WY), Sx);
+        Batch.M[3] = _mm_mul_ps(_mm_sub_ps(XY, WZ), Sy);
+        Batch.M[4] = _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(XX, ZZ)), Sy);
+        Batch.M[5] = _mm_mul_ps(_mm_add_ps(YZ, WX), Sy);
+        Batch.M[6] = _mm_mul_ps(_mm_add_ps(XZ, WY), Sz);
+        Batch.M[7] = _mm_mul_ps(_mm_sub_ps(YZ, WX), Sz);
+        Batch.M[8] = _mm_mul_ps(_mm_sub_ps(One, _mm_add_ps(XX, YY)), Sz);
+        Batch.M[9] = Tx;
+        Batch.M[10] = Ty;
+        Batch.M[11] = Tz;
+        StoreMatrixBatch(Matrices + Index, &Batch);
+    }
+}
+
+static
+void MultiplyMatricesSSE(
+    mat4x3 * restrict Results,
+    mat4x3 * restrict As,
+    mat4x3 * restrict Bs,
+    u32 Count)
+{
+    Assert(Count % 4 == 0);
+    for (u32 Index = 0; Index < Count; Index += 4) {
+        matrix_batch A, B;
+        LoadMatrixBatch(&A, As + Index);
+        LoadMatrixBatch(&B, Bs + Index);
+        MultiplyMatrixBatch(&A, &A, &B);
+        StoreMatrixBatch(Results + Index, &A);
+    }
+}
+
+static
+void MultiplyMatricesSSE(
+    mat4x3 * restrict Results,
+    mat4x3 * restrict As,
+    mat4x3 * restrict Bs,
+    mat4x3 * restrict Cs,
+    u32 Count)
+{
+    Assert(Count % 4 == 0);
+    for (u32 Index = 0; Index < Count; Index += 4) {
+        matrix_batch A, B;
+        LoadMatrixBatch(&A, As + Index);
+        LoadMatrixBatch(&B, Bs + Index);
+        MultiplyMatrixBatch(&A, &A, &B);
+        LoadMatrixBatch(&B, Cs + Index);
+        MultiplyMatrixBatch(&A, &A, &B);
+        StoreMatrixBatch(Results + Index, &A);
+    }
+}
+
+// Inverts affine matrices.  The 3x3 part may have any scale
+// or shear, its inverse is its adjugate over its determinant.
+static
+void InvertAffineMatricesSSE(
+        mat4x3 * restrict Inverted,
+        mat4x3 * restrict Source,
+        u32 Count)
+{
+    Assert(Count % 4 == 0);
+    const __m128 One = _mm_set1_ps(1.0f);
+    for (u32 Index = 0; Index < Count; Index += 4) {
+        matrix_batch S;
+        LoadMatrixBatch(&S, Source + Index);
+        __m128 *C0 = S.M + 0;
+        __m128 *C1 = S.M + 3;
+        __m128 *C2 = S.M + 6;
+
+        // the rows of the inverse are these crosses over the determinant
+        __m128 Rows[3][3];
+        __m128 *Pairs[3][2] = { { C1, C2 }, { C2, C0 }, { C0, C1 } };
+        for (u32 Row = 0; Row < 3; Row++) {
+            __m128 *U = Pairs[Row][0];
+            __m128 *V = Pairs[Row][1];
+            Rows[Row][0] = _mm_sub_ps(_mm_mul_ps(U[1], V[2]), _mm_mul_ps(U[2], V[1]));
+            Rows[Row][1] = _mm_sub_ps(_mm_mul_ps(U[2], V[0]), _mm_mul_ps(U[0], V[2]));
+            Rows[Row][2] = _mm_sub_ps(_mm_mul_ps(U[0], V[1]), _mm_mul_ps(U[1], V[0]));
+        }
+        __m128 Det = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(C0[0], Rows[0][0]),
+            _mm_mul_ps(C0[1], Rows[0][1])),
+            _mm_mul_ps(C0[2], Rows[0][2]));
+        __m128 InvDet = _mm_div_ps(One, Det);
+
+        matrix_batch R;
+        for (u32 Row = 0; Row < 3; Row++) {
+            __m128 X = _mm_mul_ps(Rows[Row][0], InvDet);
+            __m128 Y = _mm_mul_ps(Rows[Row][1], InvDet);
+            __m128 Z = _mm_mul_ps(Rows[Row][2], InvDet);
+            R.M[0 + Row] = X;
+            R.M[3 + Row] = Y;
+            R.M[6 + Row] = Z;
+            // translation is -(inverse * translation)
+            __m128 Dot = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(X, S.M[9]),
+                _mm_mul_ps(Y, S.M[10])),
+                _mm_mul_ps(Z, S.M[11]));
+            R.M[9 + Row] = _mm_sub_ps(_mm_setzero_ps(), Dot);
+        }
+        StoreMatrixBatch(Inverted + Index, &R);
+    }
+}
+
+#endif
@@ -9,17 +9,33 @@ struct floor_grid {
 };
 
 
+struct texture_decode {
+    char Filename[256];
+    int Width;
+    int Height;
+    int Bpp;
+    unsigned char *Pixels;
+};
+
+static
+DAIS_JOB_FN(DecodeTextureJob) {
+    texture_decode *Decode = (texture_decode *) Data;
+    Decode->Pixels = stbi_load(Decode->Filename, &Decode->Width, &Decode->Height, &Decode->Bpp, STBI_default);
+}
+
 static
-void LoadTexture(GLuint Texname, const char *Filename) {
+void UploadTexture(GLuint Texname, texture_decode *Decode) {
     glBindTexture(GL_TEXTURE_2D, Texname);
 
-    int Width, Height, Bpp;
-    unsigned char *Pixels = stbi_load(Filename, &Width, &Height, &Bpp, STBI_default);
+    int Width = Decode->Width;
+    int Height = Decode->Height;
+    int Bpp = Decode->Bpp;
+    unsigned char *Pixels = Decode->Pixels;
     if (!Pixels) {
-        printf("Failed to load image %s (%s)\n", Filename, stbi_failure_reason());
+        printf("Failed to load image %s (%s)\n", Decode->Filename, stbi_failure_reason());
         return;
     }
-    printf("Loaded %s, %dx%d, comp=%d\n", Filename, Width, Height, Bpp);
+    printf("Loaded %s, %dx%d, comp=%d\n", Decode->Filename, Width, Height, Bpp);
 
     GLenum Format;
     switch(Bpp) {
@@ -31,6 +47,7 @@ void LoadTexture(GLuint Texname, const char *Filename) {
         break;
     default:
         printf("Unsupported format: %d\n", Bpp);
+        stbi_image_free(Pixels);
         return;
     }
 
@@ -46,7 +63,7 @@ normal_mesh *GenerateNormalMeshes(memory_arena *Perm, memory_arena *Temp, skinne
     for (u32 MeshIndex = 0; MeshIndex < Mesh->MeshCount; MeshIndex++) {
         normal_mesh *Nor = Nors + MeshIndex;
         skinned_mesh_mesh *MeshData = Mesh->Meshes + MeshIndex;
-        u32 TempRestore = Temp->Pos;
+        arena_temp TempScope = ArenaBeginTemp(Temp);
         Nor->Count = MeshData->VertexCount;
         vec3 *NormalBuffer = ArenaAllocTN(Temp, vec3, Nor->Count * 2);
         u32 VertexSize = MeshData->VertexSize;
@@ -71,7 +88,7 @@ normal_mesh *GenerateNormalMeshes(memory_arena *Perm, memory_arena *Temp, skinne
 
         CheckGLError();
 
-        ArenaRestore(Temp, TempRestore);
+        ArenaEndTemp(TempScope);
     }
     return Nors;
 }
@@ -84,7 +101,7 @@ void InitFloorGrid(floor_grid *Grid) {
     u32 Width = (RadiusPoints * 2) - 1;
     u32 TotalPoints = Width * 4; // width points along each of the four sides
 
-    u32 TempRestore = TempArena->Pos;
+    arena_temp TempScope = ArenaBeginTemp(TempArena);
     vec2 *Points = ArenaAllocTN(TempArena, vec2, TotalPoints);
 
     float Radius = (float) RadiusPoints;
@@ -125,7 +142,7 @@ void InitFloorGrid(floor_grid *Grid) {
 
     CheckGLError();
 
-    ArenaRestore(TempArena, TempRestore);
+    ArenaEndTemp(TempScope);
 }
 
 static
@@ -172,16 +189,32 @@ void UploadMeshesToOGL(skinned_mesh *Mesh) {
         CheckGLError();
     }
 
+    // decode the images in parallel, then upload them here
+    // since GL calls must come from the main thread.
+    arena_temp TempScope = ArenaBeginTemp(TempArena);
+    texture_decode *Decodes = ArenaAllocTN(TempArena, texture_decode, Mesh->TextureCount);
+    dais_job *Jobs = ArenaAllocTN(TempArena, dais_job, Mesh->TextureCount);
+    for (u32 TexIndex = 0; TexIndex < Mesh->TextureCount; TexIndex++) {
+        texture *Tex = Mesh->Textures + TexIndex;
+        texture_decode *Decode = Decodes + TexIndex;
+        const int BufSize = sizeof(Decode->Filename);
+        strcpy(Decode->Filename, "../Avatar/");
+        strncat(Decode->Filename, Tex->TexturePath, BufSize - strlen(Decode->Filename) - 1);
+        Jobs[TexIndex].Function = DecodeTextureJob;
+        Jobs[TexIndex].Data = Decode;
+    }
+
+    dais_job_counter DecodesLeft = 0;
+    PlatformRef->PushJobs(Jobs, Mesh->TextureCount, &DecodesLeft);
+    PlatformRef->WaitForCounter(&DecodesLeft);
+
     for (u32 TexIndex = 0; TexIndex < Mesh->TextureCount; TexIndex++) {
         texture *Tex = Mesh->Textures + TexIndex;
-        const int BufSize = 256;
-        char Buffer[BufSize];
-        strcpy(Buffer, "../Avatar/");
-        strncat(Buffer, Tex->TexturePath, BufSize-1);
         glGenTextures(1, &Tex->GLTexID);
-        LoadTexture(Tex->GLTexID, Buffer);
+        UploadTexture(Tex->GLTexID, Decodes + TexIndex);
         CheckGLError();
     }
+    ArenaEndTemp(TempScope);
 }
 
 const char *DefaultVertexShader = GLSL(
@@ -378,7 +411,7 @@ skin_shader *FindOrCreateSkinShader(shader_state *State, u16 NumWeights, u16 Num
 
 static
 shader_state *InitShaders(memory_arena *Arena) {
-    shader_state *State = ArenaAllocT(Arena, shader_state);
+    shader_state *State = ArenaAllocZeroT(Arena, shader_state);
     State->ProgramID = CompileShader(DefaultVertexShader, DefaultFragmentShader);
     State->Projection = glGetUniformLocation(State->ProgramID, "Projection");
 
@@ -539,7 +572,7 @@ void RenderSkinnedMesh(shader_state *Shaders, skinned_mesh *Mesh, skeleton *Skel
 
 static
 skinned_mesh *LoadMeshData(memory_arena *Arena, void *FileData) {
-    skinned_mesh *Mesh = ArenaAllocT(Arena, skinned_mesh);
+    skinned_mesh *Mesh = ArenaAllocZeroT(Arena, skinned_mesh);
     char *FilePos = (char *)FileData;
 
     memcpy(Mesh, FilePos, 4 * sizeof(u16));
@@ -0,0 +1,5 @@
+#define IMGUI_API __attribute__ ((visibility ("default")))
+
+#include "imgui.cpp"
+#include "imgui_draw.cpp"
+#include "imgui_widgets.cpp"
@@ -10,6 +10,16 @@
 #define CHANNEL_FLAG_ROTATION (1<<1)
 #define CHANNEL_FLAG_SCALE (1<<2)
 
+// Every track has one key, or keys evenly spaced from the start of
+// the clip to the end.  Percentages are not written.
+#define ANIMATION_FLAG_UNIFORM (1<<0)
+// Keys are written as packed_keys instead of floats, and each
+// translation and scale track's bounds follow its bone's header.
+#define ANIMATION_FLAG_QUANTIZED (1<<1)
+// Zero bytes written after the last packed key, so the game can
+// load 16 bytes starting at any key.
+#define QUANTIZED_KEY_PADDING 10
+
 
 struct v3 {
     f32 x, y, z;
@@ -25,6 +35,19 @@ struct transform {
     v3 Scale;
 };
 
+// A key in a quantized animation.  Vectors are Min + Scale * Data
+// with the track's bounds.  Rotations are smallest three: the three
+// smallest components in the low 15 bits of each, and the index of
+// the largest in the top bits of the first two.
+struct packed_key {
+    u16 Data[3];
+};
+
+struct track_bounds {
+    v3 Min;
+    v3 Scale;
+};
+
 template <typename pt>
 struct timeline {
     u32 KeyframeCount;
@@ -45,6 +68,7 @@ struct bone_animation {
 struct animation {
     f32 Duration;
     u16 AnimatedBoneCount;
+    u16 Flags;
     // sorted by BoneID ASC
     bone_animation *Bones;
 };
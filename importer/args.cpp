@@ -17,6 +17,9 @@ static void printHelp(const char *programName) {
     printf("  -w maxWeights limit the max number of bone [w]eights per vertex (default 4)\n");
     printf("  -f            [f]lip the V texture axis\n");
     printf("  -p            [p]ack vertex colors into 4 bytes\n");
+    printf("  -e maxError   remove animation keys that move bones less than maxError in scene units (default 0.0001)\n");
+    printf("  -q            [q]uantize animation keys to 48 bits\n");
+    printf("  -r rate       [r]esample animation tracks at a fixed rate in samples per second\n");
     printf("  -h or -?      display this [h]elp message and exit\n");
     printf("\n");
     printf("Debugging Options:\n");
@@ -101,6 +104,34 @@ bool parseArgs(int argc, char *argv[], Options *opts) {
                 break;
             }
 
+            case 'e': {
+                float error = atof(cc);
+                if (error == 0 && cc[0] != '0') {
+                    printf("Error: couldn't parse '%s' as a number for argument -e\n", cc);
+                    goto parseError;
+                } else if (error < 0) {
+                    printf("Error: max animation error must not be negative (%f requested)\n", error);
+                    success = false;
+                } else {
+                    opts->animError = error;
+                }
+                break;
+            }
+
+            case 'r': {
+                float rate = atof(cc);
+                if (rate == 0 && cc[0] != '0') {
+                    printf("Error: couldn't parse '%s' as a number for argument -r\n", cc);
+                    goto parseError;
+                } else if (rate < 0) {
+                    printf("Error: resample rate must not be negative (%f requested)\n", rate);
+                    success = false;
+                } else {
+                    opts->resampleRate = rate;
+                }
+                break;
+            }
+
             case 'd': {
                 while (*cc) {
                     switch (*cc) {
@@ -179,6 +210,9 @@ bool parseArgs(int argc, char *argv[], Options *opts) {
         case 'p':
             opts->packVertexColors = true;
             break;
+        case 'q':
+            opts->quantizeAnimation = true;
+            break;
         case 'h':
         case '?':
             printHelp(argv[0]);
@@ -26,7 +26,12 @@ struct Options {
     int maxBlendWeights = 4;
     bool flipV = false;
     bool packVertexColors = false;
+    // max world space distance in scene units that removing
+    // animation keys may move a bone, or zero to keep every key
     float animError = 0.0001;
+    // samples per second, or zero to keep the source keys
+    float resampleRate = 0;
+    bool quantizeAnimation = false;
 
     bool dumpElementTree = false;
     bool dumpObjectTree = false;
@@ -13,5 +13,6 @@ extern "C" {
 #include "dumpfbx.cpp"
 #include "convertobj.cpp"
 #include "fbx_skinned_mesh.cpp"
+#include "reduce_animation.cpp"
 #include "fbx_animation.cpp"
 #include "model_main.cpp"
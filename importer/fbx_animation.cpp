@@ -1,7 +1,11 @@
 #include "fbx_animation.h"
+#include "reduce_animation.h"
 
 #define ANIM_TMP_MEM_SIZE Megabytes(16)
 
+// The ParentID of limbs with no limb above them
+#define NO_PARENT_LIMB 0xFFFF
+
 struct anim_state {
     memory_arena Arena;
 
@@ -37,6 +41,22 @@ void BuildSkeletonRecursive(anim_state *State, const Object *Node, u16 ParentID)
     }
 }
 
+// The setup transforms of the non-limb nodes between a limb and the
+// limb or scene root above it, composed into one matrix.  Animation
+// on those nodes isn't exported, so only their setup counts.
+static
+Matrix NonLimbAncestorMatrix(const Object *SceneRoot, const Object *Limb) {
+    Matrix Result = MakeIdentity();
+    for (const Object *Node = Limb->getParent();
+         Node && Node != SceneRoot && Node->isNode() && Node->getType() != Object::Type::LIMB_NODE;
+         Node = Node->getParent())
+    {
+        Matrix Local = Node->evalLocal(Node->getLocalTranslation(), Node->getLocalRotation(), Node->getLocalScaling());
+        Result = Mul(&Local, &Result);
+    }
+    return Result;
+}
+
 struct combine_times_data {
     memory_arena *Arena;
     u64 *Times;
@@ -129,6 +149,22 @@ combined_times ComputeSampleTimes(anim_state *State, const AnimationCurveNode *C
     return (combined_times){CombinedTimes.Count, CombinedTimes.Times};
 }
 
+// Replaces a channel's key times with Count times spaced evenly
+// over the clip, so key i lands at percent i / (Count - 1).
+// Channels with a single key are constant, and keep it.
+static
+combined_times UniformSampleTimes(anim_state *State, combined_times Keys, u32 Count, double StartTime, double Timespan) {
+    if (Keys.Count <= 1) return Keys;
+
+    combined_times Result;
+    Result.Count = Count;
+    Result.Times = ArenaAllocTN(&State->Arena, u64, Count);
+    for (u32 Index = 0; Index < Count; Index++) {
+        Result.Times[Index] = secondsToFbxTime(StartTime + Timespan * Index / (Count - 1));
+    }
+    return Result;
+}
+
 struct sample_state {
     memory_arena *Arena;
     const Object *FbxNode;
@@ -213,12 +249,31 @@ animation *ConvertFBXToAnimation(const IScene *Scene, Options *Opts) {
     bone_assignment Assignment = ReadBoneAssignment(Opts->mapping, &State.Arena);
 
     const Object *Root = Scene->getRoot();
-    BuildSkeletonRecursive(&State, Root, 0);
+    BuildSkeletonRecursive(&State, Root, NO_PARENT_LIMB);
     u32 LimbCount = ReverseLinkedList((void **) &State.Limbs);
 
     Result->Duration = (f32) Timespan;
+
+    u32 UniformCount = 0;
+    if (Opts->resampleRate > 0) {
+        Result->Flags |= ANIMATION_FLAG_UNIFORM;
+        // at least the requested rate, and samples at both ends
+        UniformCount = (u32) ceil(Timespan * Opts->resampleRate) + 1;
+        if (UniformCount < 2) UniformCount = 2;
+        if (UniformCount > 0xFFFF) {
+            printf("Error: resampling at %f per second needs %u keys per track, the format allows %u.\n",
+                Opts->resampleRate, UniformCount, 0xFFFF);
+            exit(0);
+        }
+        printf("Resampling to %u keys per track\n", UniformCount);
+    }
+    if (Opts->quantizeAnimation) {
+        Result->Flags |= ANIMATION_FLAG_QUANTIZED;
+    }
     Result->Bones = ArenaAllocTN(&State.Arena, bone_animation, LimbCount);
     bone_animation *NextAnim = Result->Bones;
+    // indexed by limb ID, for measuring reduction error in world space
+    reduce_bone *ReduceBones = ArenaAllocTN(&State.Arena, reduce_bone, LimbCount);
     limb_node_info *Node = State.Limbs;
     while (Node) {
         const Object *FbxNode = Node->Source;
@@ -228,6 +283,11 @@ animation *ConvertFBXToAnimation(const IScene *Scene, Options *Opts) {
         combined_times TranslationSamples = ComputeSampleTimes(&State, Translation);
         combined_times RotationSamples = ComputeSampleTimes(&State, Rotation);
         combined_times ScaleSamples = ComputeSampleTimes(&State, Scale);
+        if (UniformCount) {
+            TranslationSamples = UniformSampleTimes(&State, TranslationSamples, UniformCount, StartTime, Timespan);
+            RotationSamples = UniformSampleTimes(&State, RotationSamples, UniformCount, StartTime, Timespan);
+            ScaleSamples = UniformSampleTimes(&State, ScaleSamples, UniformCount, StartTime, Timespan);
+        }
 
         sample_state SampleState = {};
         SampleState.Arena = &State.Arena;
@@ -242,6 +302,20 @@ animation *ConvertFBXToAnimation(const IScene *Scene, Options *Opts) {
         SampleState.Timespan = Timespan;
 
 
+        reduce_bone *ReduceBone = ReduceBones + Node->ID;
+        ReduceBone->ParentIndex = (Node->ParentID == NO_PARENT_LIMB) ? REDUCE_NO_PARENT : Node->ParentID;
+        ReduceBone->Anim = nullptr;
+        Matrix StaticMatrix = FbxNode->evalLocal(SampleState.LocalTranslation, SampleState.LocalRotation, SampleState.LocalScale);
+        ExtractTransform(&StaticMatrix,
+            &ReduceBone->Static.Translation.x,
+            &ReduceBone->Static.Rotation.x,
+            &ReduceBone->Static.Scale.x);
+        Matrix OffsetMatrix = NonLimbAncestorMatrix(Root, FbxNode);
+        ExtractTransform(&OffsetMatrix,
+            &ReduceBone->Offset.Translation.x,
+            &ReduceBone->Offset.Rotation.x,
+            &ReduceBone->Offset.Scale.x);
+
         u16 Flags = 0;
         if (TranslationSamples.Count) {
             Flags |= CHANNEL_FLAG_TRANSLATION;
@@ -258,6 +332,7 @@ animation *ConvertFBXToAnimation(const IScene *Scene, Options *Opts) {
             SampleAnimation(&SampleState, TranslationSamples, &NextAnim->Translations, ExtractTranslation);
             SampleAnimation(&SampleState, RotationSamples, &NextAnim->Rotations, ExtractRotation);
             SampleAnimation(&SampleState, ScaleSamples, &NextAnim->Scales, ExtractScale);
+            ReduceBone->Anim = NextAnim;
 
             // printf("Bone %d [%s]\n", Node->ID, FbxNode->name);
             // for (u32 c = 0; c < NextAnim->Translations.KeyframeCount; c++) {
@@ -291,9 +366,106 @@ animation *ConvertFBXToAnimation(const IScene *Scene, Options *Opts) {
     }
 
     printf("Animated %d/%d bones\n", Result->AnimatedBoneCount, LimbCount);
+
+    if (Opts->animError > 0 && LimbCount) {
+        if (Result->Flags & ANIMATION_FLAG_UNIFORM) {
+            // uniform tracks can't drop keys without losing their spacing
+            printf("Skipping key reduction for a resampled animation\n");
+        } else {
+            ReduceAnimation(ReduceBones, LimbCount, Opts->animError);
+        }
+    }
     return Result;
 }
 
+// The three smaller components of a unit quaternion are within
+// +-1/sqrt(2), and are stored over that range in 15 bits.
+#define QUAT_KEY_RANGE 0.70710678f
+#define QUAT_KEY_STEP (2 * QUAT_KEY_RANGE / 0x7FFF)
+
+static
+track_bounds ComputeBounds(timeline<v3> *Timeline) {
+    v3 Min = Timeline->Values[0];
+    v3 Max = Timeline->Values[0];
+    for (u32 Index = 1; Index < Timeline->KeyframeCount; Index++) {
+        v3 Value = Timeline->Values[Index];
+        SetMin(Min.x, Value.x);
+        SetMin(Min.y, Value.y);
+        SetMin(Min.z, Value.z);
+        SetMax(Max.x, Value.x);
+        SetMax(Max.y, Value.y);
+        SetMax(Max.z, Value.z);
+    }
+    track_bounds Bounds;
+    Bounds.Min = Min;
+    Bounds.Scale.x = (Max.x - Min.x) / 0xFFFF;
+    Bounds.Scale.y = (Max.y - Min.y) / 0xFFFF;
+    Bounds.Scale.z = (Max.z - Min.z) / 0xFFFF;
+    return Bounds;
+}
+
+static inline
+u16 PackFloat(f32 Value, f32 Min, f32 Scale, u32 MaxPacked) {
+    if (Scale <= 0) return 0;
+    f32 Packed = roundf((Value - Min) / Scale);
+    if (Packed < 0) return 0;
+    if (Packed > MaxPacked) return (u16) MaxPacked;
+    return (u16) Packed;
+}
+
+static
+packed_key PackVector(v3 Value, track_bounds *Bounds) {
+    packed_key Key;
+    Key.Data[0] = PackFloat(Value.x, Bounds->Min.x, Bounds->Scale.x, 0xFFFF);
+    Key.Data[1] = PackFloat(Value.y, Bounds->Min.y, Bounds->Scale.y, 0xFFFF);
+    Key.Data[2] = PackFloat(Value.z, Bounds->Min.z, Bounds->Scale.z, 0xFFFF);
+    return Key;
+}
+
+static
+packed_key PackQuat(quat Value) {
+    f32 Components[4] = { Value.x, Value.y, Value.z, Value.w };
+    f32 Length = sqrtf(Components[0]*Components[0] + Components[1]*Components[1] +
+                       Components[2]*Components[2] + Components[3]*Components[3]);
+    u32 Largest = 0;
+    for (u32 Index = 0; Index < 4; Index++) {
+        Components[Index] /= Length;
+        if (fabsf(Components[Index]) > fabsf(Components[Largest])) Largest = Index;
+    }
+    // q and -q are the same rotation, so make the largest positive
+    // and the game can rebuild it from the other three.
+    f32 Sign = Components[Largest] < 0 ? -1 : 1;
+
+    packed_key Key;
+    u32 Field = 0;
+    for (u32 Index = 0; Index < 4; Index++) {
+        if (Index == Largest) continue;
+        f32 Component = Sign * Components[Index];
+        Key.Data[Field++] = PackFloat(Component, -QUAT_KEY_RANGE, QUAT_KEY_STEP, 0x7FFF);
+    }
+    Key.Data[0] |= (Largest & 1) << 15;
+    Key.Data[1] |= (Largest >> 1) << 15;
+    return Key;
+}
+
+static
+void WritePackedVectors(timeline<v3> *Timeline, FILE *File) {
+    if (!Timeline->KeyframeCount) return;
+    track_bounds Bounds = ComputeBounds(Timeline);
+    for (u32 Index = 0; Index < Timeline->KeyframeCount; Index++) {
+        packed_key Key = PackVector(Timeline->Values[Index], &Bounds);
+        fwrite(&Key, 1, sizeof(packed_key), File);
+    }
+}
+
+static
+void WritePackedQuats(timeline<quat> *Timeline, FILE *File) {
+    for (u32 Index = 0; Index < Timeline->KeyframeCount; Index++) {
+        packed_key Key = PackQuat(Timeline->Values[Index]);
+        fwrite(&Key, 1, sizeof(packed_key), File);
+    }
+}
+
 bool WriteAnimation(animation *Anim, const char *Filename) {
     FILE *File = fopen(Filename, "wb");
     if (!File) {
@@ -306,7 +478,7 @@ bool WriteAnimation(animation *Anim, const char *Filename) {
     fwrite(&Pad, 1, sizeof(u32), File);
     fwrite(&Anim->Duration, 1, sizeof(f32), File);
     fwrite(&Anim->AnimatedBoneCount, 1, sizeof(u16), File);
-    fwrite(&Pad, 1, sizeof(u16), File);
+    fwrite(&Anim->Flags, 1, sizeof(u16), File);
 
     for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
         bone_animation *Bone = Anim->Bones + BoneIndex;
@@ -314,45 +486,69 @@ bool WriteAnimation(animation *Anim, const char *Filename) {
         fwrite(&Bone->Translations.KeyframeCount, 1, sizeof(u16), File);
         fwrite(&Bone->Rotations.KeyframeCount, 1, sizeof(u16), File);
         fwrite(&Bone->Scales.KeyframeCount, 1, sizeof(u16), File);
+        if (Anim->Flags & ANIMATION_FLAG_QUANTIZED) {
+            if (Bone->Translations.KeyframeCount) {
+                track_bounds Bounds = ComputeBounds(&Bone->Translations);
+                fwrite(&Bounds, 1, sizeof(track_bounds), File);
+            }
+            if (Bone->Scales.KeyframeCount) {
+                track_bounds Bounds = ComputeBounds(&Bone->Scales);
+                fwrite(&Bounds, 1, sizeof(track_bounds), File);
+            }
+        }
     }
 
     u32 PercentStart = ftell(File);
-    for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
-        bone_animation *Bone = Anim->Bones + BoneIndex;
-        if (Bone->Translations.KeyframeCount) {
-            fwrite(Bone->Translations.Percentages,
-                Bone->Translations.KeyframeCount,
-                sizeof(f32), File);
-        }
-        if (Bone->Rotations.KeyframeCount) {
-            fwrite(Bone->Rotations.Percentages,
-                Bone->Rotations.KeyframeCount,
-                sizeof(f32), File);
-        }
-        if (Bone->Scales.KeyframeCount) {
-            fwrite(Bone->Scales.Percentages,
-                Bone->Scales.KeyframeCount,
-                sizeof(f32), File);
+    // uniform animations imply their percentages
+    if (!(Anim->Flags & ANIMATION_FLAG_UNIFORM)) {
+        for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+            bone_animation *Bone = Anim->Bones + BoneIndex;
+            if (Bone->Translations.KeyframeCount) {
+                fwrite(Bone->Translations.Percentages,
+                    Bone->Translations.KeyframeCount,
+                    sizeof(f32), File);
+            }
+            if (Bone->Rotations.KeyframeCount) {
+                fwrite(Bone->Rotations.Percentages,
+                    Bone->Rotations.KeyframeCount,
+                    sizeof(f32), File);
+            }
+            if (Bone->Scales.KeyframeCount) {
+                fwrite(Bone->Scales.Percentages,
+                    Bone->Scales.KeyframeCount,
+                    sizeof(f32), File);
+            }
         }
     }
 
     u32 DataStart = ftell(File);
-    for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
-        bone_animation *Bone = Anim->Bones + BoneIndex;
-        if (Bone->Translations.KeyframeCount) {
-            fwrite(Bone->Translations.Values,
-                Bone->Translations.KeyframeCount,
-                sizeof(v3), File);
-        }
-        if (Bone->Rotations.KeyframeCount) {
-            fwrite(Bone->Rotations.Values,
-                Bone->Rotations.KeyframeCount,
-                sizeof(quat), File);
+    if (Anim->Flags & ANIMATION_FLAG_QUANTIZED) {
+        for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+            bone_animation *Bone = Anim->Bones + BoneIndex;
+            WritePackedVectors(&Bone->Translations, File);
+            WritePackedQuats(&Bone->Rotations, File);
+            WritePackedVectors(&Bone->Scales, File);
         }
-        if (Bone->Scales.KeyframeCount) {
-            fwrite(Bone->Scales.Values,
-                Bone->Scales.KeyframeCount,
-                sizeof(v3), File);
+        u8 Padding[QUANTIZED_KEY_PADDING] = {};
+        fwrite(Padding, 1, sizeof(Padding), File);
+    } else {
+        for (u32 BoneIndex = 0; BoneIndex < Anim->AnimatedBoneCount; BoneIndex++) {
+            bone_animation *Bone = Anim->Bones + BoneIndex;
+            if (Bone->Translations.KeyframeCount) {
+                fwrite(Bone->Translations.Values,
+                    Bone->Translations.KeyframeCount,
+                    sizeof(v3), File);
+            }
+            if (Bone->Rotations.KeyframeCount) {
+                fwrite(Bone->Rotations.Values,
+                    Bone->Rotations.KeyframeCount,
+                    sizeof(quat), File);
+            }
+            if (Bone->Scales.KeyframeCount) {
+                fwrite(Bone->Scales.Values,
+                    Bone->Scales.KeyframeCount,
+                    sizeof(v3), File);
+            }
         }
     }
 
@@ -0,0 +1,446 @@
+#include "reduce_animation.h"
+
+// Error is checked at each bone's origin, and at points this far
+// along each of its raw axes, in scene units.  The points stand in
+// for the skin around the bone, so that a rotation or scale error
+// on a bone with no children, like a fingertip, still counts.
+#define REDUCE_SHELL_DISTANCE 3.0
+
+// A transform in doubles, so error measurements aren't lost in
+// float rounding far from the origin.
+struct reduce_xform {
+    f64 T[3];
+    f64 R[4]; // x y z w
+    f64 S[3];
+};
+
+struct reduce_context {
+    reduce_bone *Bones;
+    u32 BoneCount;
+    // every time any key falls on, sorted and unique
+    f32 *Times;
+    u32 TimeCount;
+    f64 MaxError;
+    // [Bone * TimeCount + Time]
+    reduce_xform *RawLocal;
+    reduce_xform *RawWorld;
+    reduce_xform *ReducedWorld;
+    // [Bone], whether the bone being reduced moves it
+    bool *InSubtree;
+    // [Bone], world transforms for the candidate being checked
+    reduce_xform *Scratch;
+    // [Bone], reduce_bone::Offset
+    reduce_xform *Offsets;
+};
+
+struct reduce_track {
+    u32 *KeyframeCount;
+    f32 *Percentages;
+    f32 *Values;
+    // floats per value, 3 or 4
+    u32 Width;
+    // 0 translation, 1 rotation, 2 scale
+    u32 Channel;
+};
+
+static inline
+void QuatMul(const f64 *A, const f64 *B, f64 *Out) {
+    Out[0] = A[3]*B[0] + A[0]*B[3] + A[1]*B[2] - A[2]*B[1];
+    Out[1] = A[3]*B[1] - A[0]*B[2] + A[1]*B[3] + A[2]*B[0];
+    Out[2] = A[3]*B[2] + A[0]*B[1] - A[1]*B[0] + A[2]*B[3];
+    Out[3] = A[3]*B[3] - A[0]*B[0] - A[1]*B[1] - A[2]*B[2];
+}
+
+static inline
+void QuatRotate(const f64 *Q, const f64 *V, f64 *Out) {
+    // t = 2 cross(q, v), v' = v + w t + cross(q, t)
+    f64 T[3] = {
+        2 * (Q[1]*V[2] - Q[2]*V[1]),
+        2 * (Q[2]*V[0] - Q[0]*V[2]),
+        2 * (Q[0]*V[1] - Q[1]*V[0]),
+    };
+    Out[0] = V[0] + Q[3]*T[0] + (Q[1]*T[2] - Q[2]*T[1]);
+    Out[1] = V[1] + Q[3]*T[1] + (Q[2]*T[0] - Q[0]*T[2]);
+    Out[2] = V[2] + Q[3]*T[2] + (Q[0]*T[1] - Q[1]*T[0]);
+}
+
+static
+void TransformPoint(const reduce_xform &X, const f64 *Point, f64 *Out) {
+    f64 Scaled[3] = { X.S[0] * Point[0], X.S[1] * Point[1], X.S[2] * Point[2] };
+    QuatRotate(X.R, Scaled, Out);
+    Out[0] += X.T[0];
+    Out[1] += X.T[1];
+    Out[2] += X.T[2];
+}
+
+// Parent * Child, the same way the game composes transforms.
+static
+reduce_xform Compose(const reduce_xform &Parent, const reduce_xform &Child) {
+    reduce_xform Result;
+    TransformPoint(Parent, Child.T, Result.T);
+    QuatMul(Parent.R, Child.R, Result.R);
+    for (u32 Axis = 0; Axis < 3; Axis++) {
+        Result.S[Axis] = Parent.S[Axis] * Child.S[Axis];
+    }
+    return Result;
+}
+
+// The largest distance between where Reduced and Raw put the
+// bone's origin and its shell points.  The points are placed in
+// the bone's space so that Raw puts them REDUCE_SHELL_DISTANCE
+// away, whatever the bone's world scale.
+static
+f64 PointError(const reduce_xform &Reduced, const reduce_xform &Raw) {
+    f64 Error = 0;
+    for (u32 PointIndex = 0; PointIndex < 4; PointIndex++) {
+        f64 Point[3] = {};
+        if (PointIndex < 3) {
+            f64 Scale = fabs(Raw.S[PointIndex]);
+            Point[PointIndex] = REDUCE_SHELL_DISTANCE / (Scale > 1e-9 ? Scale : 1.0);
+        }
+        f64 PA[3], PB[3];
+        TransformPoint(Reduced, Point, PA);
+        TransformPoint(Raw, Point, PB);
+        f64 DX = PA[0] - PB[0];
+        f64 DY = PA[1] - PB[1];
+        f64 DZ = PA[2] - PB[2];
+        SetMax(Error, sqrt(DX*DX + DY*DY + DZ*DZ));
+    }
+    return Error;
+}
+
+static
+void SetChannel(reduce_xform *X, u32 Channel, const f64 *Value) {
+    switch (Channel) {
+    case 0: memcpy(X->T, Value, 3 * sizeof(f64)); break;
+    case 1: memcpy(X->R, Value, 4 * sizeof(f64)); break;
+    case 2: memcpy(X->S, Value, 3 * sizeof(f64)); break;
+    }
+}
+
+static
+reduce_xform XformFromTransform(const transform &Trans) {
+    reduce_xform X;
+    const f32 *T = &Trans.Translation.x;
+    const f32 *R = &Trans.Rotation.x;
+    const f32 *S = &Trans.Scale.x;
+    for (u32 Index = 0; Index < 3; Index++) X.T[Index] = T[Index];
+    for (u32 Index = 0; Index < 4; Index++) X.R[Index] = R[Index];
+    for (u32 Index = 0; Index < 3; Index++) X.S[Index] = S[Index];
+    return X;
+}
+
+// A lerp for vectors, and an nlerp along the shorter arc for
+// rotations.  The game's Mix doesn't normalize; this models the
+// transform hierarchy path, which normalizes each local rotation
+// in UpdateMatricesFromTransformsQV.  The matrix path uses the
+// short quaternion as it is, so between keys its error can be
+// larger than MaxError.
+static
+void MixValues(const f32 *A, const f32 *B, u32 Width, f64 Interp, f64 *Out) {
+    f64 Sign = 1;
+    if (Width == 4) {
+        f64 Dot = A[0]*B[0] + A[1]*B[1] + A[2]*B[2] + A[3]*B[3];
+        if (Dot < 0) Sign = -1;
+    }
+    for (u32 Index = 0; Index < Width; Index++) {
+        Out[Index] = (1 - Interp) * A[Index] + Sign * Interp * B[Index];
+    }
+    if (Width == 4) {
+        f64 Length = sqrt(Out[0]*Out[0] + Out[1]*Out[1] + Out[2]*Out[2] + Out[3]*Out[3]);
+        for (u32 Index = 0; Index < 4; Index++) Out[Index] /= Length;
+    }
+}
+
+// Samples keys From and To at Percent, clamped to the span between them.
+static
+void SampleBetween(reduce_track *Track, u32 From, u32 To, f32 Percent, f64 *Out) {
+    f32 Lowp = Track->Percentages[From];
+    f32 Highp = Track->Percentages[To];
+    f64 Interp = (Highp > Lowp) ? ((f64) Percent - Lowp) / ((f64) Highp - Lowp) : 0;
+    Interp = Min(Max(Interp, 0.0), 1.0);
+    u32 Width = Track->Width;
+    MixValues(Track->Values + From * Width, Track->Values + To * Width, Width, Interp, Out);
+}
+
+static
+void SampleTrack(reduce_track *Track, f32 Percent, f64 *Out) {
+    u32 Count = *Track->KeyframeCount;
+    if (Count == 1) {
+        for (u32 Index = 0; Index < Track->Width; Index++) Out[Index] = Track->Values[Index];
+        return;
+    }
+    // the last key at or before Percent, but never the last key
+    u32 Low = 0;
+    u32 High = Count - 1;
+    while (Low + 1 < High) {
+        u32 Mid = (Low + High) / 2;
+        if (Track->Percentages[Mid] <= Percent) {
+            Low = Mid;
+        } else {
+            High = Mid;
+        }
+    }
+    SampleBetween(Track, Low, Low + 1, Percent, Out);
+}
+
+// Index of the first time that is at least Percent.
+static
+u32 FindTime(f32 *Times, u32 TimeCount, f32 Percent) {
+    u32 Low = 0;
+    u32 High = TimeCount;
+    while (Low < High) {
+        u32 Mid = (Low + High) / 2;
+        if (Times[Mid] < Percent) {
+            Low = Mid + 1;
+        } else {
+            High = Mid;
+        }
+    }
+    return Low;
+}
+
+static
+int CompareTimes(const void *A, const void *B) {
+    f32 TA = *(const f32 *) A;
+    f32 TB = *(const f32 *) B;
+    return (TA > TB) - (TA < TB);
+}
+
+static
+u32 GetTracks(bone_animation *Anim, reduce_track *Tracks) {
+    u32 TrackCount = 0;
+    if (!Anim) return 0;
+    if (Anim->Translations.KeyframeCount) {
+        Tracks[TrackCount++] = { &Anim->Translations.KeyframeCount, Anim->Translations.Percentages, (f32 *) Anim->Translations.Values, 3, 0 };
+    }
+    if (Anim->Rotations.KeyframeCount) {
+        Tracks[TrackCount++] = { &Anim->Rotations.KeyframeCount, Anim->Rotations.Percentages, (f32 *) Anim->Rotations.Values, 4, 1 };
+    }
+    if (Anim->Scales.KeyframeCount) {
+        Tracks[TrackCount++] = { &Anim->Scales.KeyframeCount, Anim->Scales.Percentages, (f32 *) Anim->Scales.Values, 3, 2 };
+    }
+    return TrackCount;
+}
+
+// Samples every track of the bone at each time, into Local.
+static
+void SampleBone(reduce_bone *Bone, f32 *Times, u32 TimeCount, reduce_xform *Local) {
+    reduce_track Tracks[3];
+    u32 TrackCount = GetTracks(Bone->Anim, Tracks);
+    reduce_xform Static = XformFromTransform(Bone->Static);
+    for (u32 TimeIndex = 0; TimeIndex < TimeCount; TimeIndex++) {
+        Local[TimeIndex] = Static;
+        for (u32 TrackIndex = 0; TrackIndex < TrackCount; TrackIndex++) {
+            f64 Value[4];
+            SampleTrack(Tracks + TrackIndex, Times[TimeIndex], Value);
+            SetChannel(Local + TimeIndex, Tracks[TrackIndex].Channel, Value);
+        }
+    }
+}
+
+// The bone's world transform from its local one, and its parent's
+// world transform, which is ignored for bones with no parent.
+static inline
+reduce_xform BoneWorld(reduce_context *Ctx, u32 BoneIndex, const reduce_xform &ParentWorld, const reduce_xform &Local) {
+    reduce_xform Placed = Compose(Ctx->Offsets[BoneIndex], Local);
+    if (Ctx->Bones[BoneIndex].ParentIndex == REDUCE_NO_PARENT) return Placed;
+    return Compose(ParentWorld, Placed);
+}
+
+// Whether the bone and everything below it stay within MaxError of
+// the raw animation at one time, with the bone's local transform
+// replaced by Local.  Its ancestors have already been reduced, and
+// its descendants haven't yet, so any error they have counts
+// against the budget here, and is checked again as each descendant
+// is reduced in turn.
+static
+bool WithinError(reduce_context *Ctx, u32 BoneIndex, u32 TimeIndex, const reduce_xform &Local) {
+    u32 TimeCount = Ctx->TimeCount;
+    reduce_xform *Scratch = Ctx->Scratch;
+    u32 ParentIndex = Ctx->Bones[BoneIndex].ParentIndex;
+    reduce_xform *ParentWorld = Ctx->ReducedWorld +
+        (ParentIndex == REDUCE_NO_PARENT ? BoneIndex : ParentIndex) * TimeCount;
+    Scratch[BoneIndex] = BoneWorld(Ctx, BoneIndex, ParentWorld[TimeIndex], Local);
+    if (PointError(Scratch[BoneIndex], Ctx->RawWorld[BoneIndex * TimeCount + TimeIndex]) > Ctx->MaxError) {
+        return false;
+    }
+
+    for (u32 ChildIndex = BoneIndex + 1; ChildIndex < Ctx->BoneCount; ChildIndex++) {
+        if (!Ctx->InSubtree[ChildIndex]) continue;
+        u32 Index = ChildIndex * TimeCount + TimeIndex;
+        Scratch[ChildIndex] = BoneWorld(Ctx, ChildIndex, Scratch[Ctx->Bones[ChildIndex].ParentIndex], Ctx->RawLocal[Index]);
+        if (PointError(Scratch[ChildIndex], Ctx->RawWorld[Index]) > Ctx->MaxError) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Greedily removes keys from one track of a bone, front to back.
+// A key goes if, with it gone, WithinError holds at every time
+// between the kept key before it and the key after it.  Local holds
+// the bone's current local transforms, and is updated to match.
+// Returns the number of keys removed.
+static
+u32 ReduceTrack(reduce_context *Ctx, u32 BoneIndex, reduce_track *Track, reduce_xform *Local) {
+    u32 Count = *Track->KeyframeCount;
+    if (Count <= 2) return 0;
+
+    f32 *Times = Ctx->Times;
+    u32 TimeCount = Ctx->TimeCount;
+    u32 Width = Track->Width;
+    bool *Keep = (bool *) calloc(Count, sizeof(bool));
+    Keep[0] = Keep[Count - 1] = true;
+    u32 Prev = 0;
+    for (u32 Key = 1; Key < Count - 1; Key++) {
+        u32 Next = Key + 1;
+        u32 Start = FindTime(Times, TimeCount, Track->Percentages[Prev]);
+        u32 End = FindTime(Times, TimeCount, Track->Percentages[Next]);
+
+        bool Removable = true;
+        for (u32 TimeIndex = Start; TimeIndex < End && Removable; TimeIndex++) {
+            f64 Value[4];
+            SampleBetween(Track, Prev, Next, Times[TimeIndex], Value);
+            reduce_xform Candidate = Local[TimeIndex];
+            SetChannel(&Candidate, Track->Channel, Value);
+            Removable = WithinError(Ctx, BoneIndex, TimeIndex, Candidate);
+        }
+
+        if (Removable) {
+            for (u32 TimeIndex = Start; TimeIndex < End; TimeIndex++) {
+                f64 Value[4];
+                SampleBetween(Track, Prev, Next, Times[TimeIndex], Value);
+                SetChannel(Local + TimeIndex, Track->Channel, Value);
+            }
+        } else {
+            Keep[Key] = true;
+            Prev = Key;
+        }
+    }
+
+    u32 Kept = 0;
+    for (u32 Key = 0; Key < Count; Key++) {
+        if (!Keep[Key]) continue;
+        Track->Percentages[Kept] = Track->Percentages[Key];
+        memmove(Track->Values + Kept * Width, Track->Values + Key * Width, Width * sizeof(f32));
+        Kept++;
+    }
+    free(Keep);
+
+    *Track->KeyframeCount = Kept;
+    return Count - Kept;
+}
+
+void ReduceAnimation(reduce_bone *Bones, u32 BoneCount, f32 MaxError) {
+    // Between these times every track is linear, so these are the
+    // only times that need checking.
+    u32 TotalKeys = 0;
+    for (u32 BoneIndex = 0; BoneIndex < BoneCount; BoneIndex++) {
+        reduce_track Tracks[3];
+        u32 TrackCount = GetTracks(Bones[BoneIndex].Anim, Tracks);
+        for (u32 TrackIndex = 0; TrackIndex < TrackCount; TrackIndex++) {
+            TotalKeys += *Tracks[TrackIndex].KeyframeCount;
+        }
+    }
+    if (TotalKeys == 0) return;
+
+    f32 *Times = (f32 *) malloc(TotalKeys * sizeof(f32));
+    u32 TimeCount = 0;
+    for (u32 BoneIndex = 0; BoneIndex < BoneCount; BoneIndex++) {
+        reduce_track Tracks[3];
+        u32 TrackCount = GetTracks(Bones[BoneIndex].Anim, Tracks);
+        for (u32 TrackIndex = 0; TrackIndex < TrackCount; TrackIndex++) {
+            reduce_track *Track = Tracks + TrackIndex;
+            memcpy(Times + TimeCount, Track->Percentages, *Track->KeyframeCount * sizeof(f32));
+            TimeCount += *Track->KeyframeCount;
+        }
+    }
+    qsort(Times, TimeCount, sizeof(f32), CompareTimes);
+    u32 UniqueCount = 1;
+    for (u32 TimeIndex = 1; TimeIndex < TimeCount; TimeIndex++) {
+        if (Times[TimeIndex] != Times[UniqueCount - 1]) {
+            Times[UniqueCount++] = Times[TimeIndex];
+        }
+    }
+    TimeCount = UniqueCount;
+
+    u32 XformCount = BoneCount * TimeCount;
+    reduce_context Ctx;
+    Ctx.Bones = Bones;
+    Ctx.BoneCount = BoneCount;
+    Ctx.Times = Times;
+    Ctx.TimeCount = TimeCount;
+    Ctx.MaxError = MaxError;
+    Ctx.RawLocal = (reduce_xform *) malloc(XformCount * sizeof(reduce_xform));
+    Ctx.RawWorld = (reduce_xform *) malloc(XformCount * sizeof(reduce_xform));
+    Ctx.ReducedWorld = (reduce_xform *) malloc(XformCount * sizeof(reduce_xform));
+    Ctx.InSubtree = (bool *) malloc(BoneCount * sizeof(bool));
+    Ctx.Scratch = (reduce_xform *) malloc(BoneCount * sizeof(reduce_xform));
+    Ctx.Offsets = (reduce_xform *) malloc(BoneCount * sizeof(reduce_xform));
+    for (u32 BoneIndex = 0; BoneIndex < BoneCount; BoneIndex++) {
+        Assert(Bones[BoneIndex].ParentIndex == REDUCE_NO_PARENT || Bones[BoneIndex].ParentIndex < BoneIndex);
+        Ctx.Offsets[BoneIndex] = XformFromTransform(Bones[BoneIndex].Offset);
+    }
+    reduce_xform *Local = (reduce_xform *) malloc(TimeCount * sizeof(reduce_xform));
+
+    for (u32 BoneIndex = 0; BoneIndex < BoneCount; BoneIndex++) {
+        reduce_xform *RawLocal = Ctx.RawLocal + BoneIndex * TimeCount;
+        reduce_xform *World = Ctx.RawWorld + BoneIndex * TimeCount;
+        u32 ParentIndex = Bones[BoneIndex].ParentIndex;
+        reduce_xform *ParentWorld = Ctx.RawWorld +
+            (ParentIndex == REDUCE_NO_PARENT ? BoneIndex : ParentIndex) * TimeCount;
+        SampleBone(Bones + BoneIndex, Times, TimeCount, RawLocal);
+        for (u32 TimeIndex = 0; TimeIndex < TimeCount; TimeIndex++) {
+            World[TimeIndex] = BoneWorld(&Ctx, BoneIndex, ParentWorld[TimeIndex], RawLocal[TimeIndex]);
+        }
+    }
+
+    // Parents first, so each bone is reduced against its parent's
+    // reduced motion rather than the raw one.
+    u32 RemovedKeys = 0;
+    for (u32 BoneIndex = 0; BoneIndex < BoneCount; BoneIndex++) {
+        reduce_bone *Bone = Bones + BoneIndex;
+
+        // parents come before their children, so one pass finds them all
+        for (u32 Index = 0; Index < BoneCount; Index++) {
+            u32 ParentIndex = Bones[Index].ParentIndex;
+            Ctx.InSubtree[Index] = Index == BoneIndex ||
+                (Index > BoneIndex && ParentIndex != REDUCE_NO_PARENT && Ctx.InSubtree[ParentIndex]);
+        }
+
+        memcpy(Local, Ctx.RawLocal + BoneIndex * TimeCount, TimeCount * sizeof(reduce_xform));
+        reduce_track Tracks[3];
+        u32 TrackCount = GetTracks(Bone->Anim, Tracks);
+        for (u32 TrackIndex = 0; TrackIndex < TrackCount; TrackIndex++) {
+            RemovedKeys += ReduceTrack(&Ctx, BoneIndex, Tracks + TrackIndex, Local);
+        }
+
+        // Resample rather than keeping Local, so the error reported
+        // below is measured from the keys that are actually written.
+        SampleBone(Bone, Times, TimeCount, Local);
+        reduce_xform *World = Ctx.ReducedWorld + BoneIndex * TimeCount;
+        reduce_xform *ParentWorld = Ctx.ReducedWorld +
+            (Bone->ParentIndex == REDUCE_NO_PARENT ? BoneIndex : Bone->ParentIndex) * TimeCount;
+        for (u32 TimeIndex = 0; TimeIndex < TimeCount; TimeIndex++) {
+            World[TimeIndex] = BoneWorld(&Ctx, BoneIndex, ParentWorld[TimeIndex], Local[TimeIndex]);
+        }
+    }
+
+    f64 WorstError = 0;
+    for (u32 Index = 0; Index < XformCount; Index++) {
+        SetMax(WorstError, PointError(Ctx.ReducedWorld[Index], Ctx.RawWorld[Index]));
+    }
+
+    printf("Reduced keys: removed %u of %u (%.1f%%), max error %g\n",
+           RemovedKeys, TotalKeys, 100.0 * RemovedKeys / TotalKeys, WorstError);
+
+    free(Local);
+    free(Ctx.Offsets);
+    free(Ctx.Scratch);
+    free(Ctx.InSubtree);
+    free(Ctx.ReducedWorld);
+    free(Ctx.RawWorld);
+    free(Ctx.RawLocal);
+    free(Times);
+}
@@ -0,0 +1,26 @@
+#ifndef REDUCE_ANIMATION_H_
+#define REDUCE_ANIMATION_H_
+
+#include "animation_types.h"
+
+// The ParentIndex of bones with no parent bone.
+#define REDUCE_NO_PARENT 0xFFFF
+
+struct reduce_bone {
+    // less than this bone's index, or REDUCE_NO_PARENT
+    u16 ParentIndex;
+    // null if the bone isn't animated
+    bone_animation *Anim;
+    // the local transform for channels that aren't animated
+    transform Static;
+    // the nodes between this bone and its parent bone, or the
+    // scene root if it has none, as one transform
+    transform Offset;
+};
+
+// Removes keys that interpolating their neighbors reproduces
+// within MaxError, measured as distance in world space.
+// Prints a report of keys removed and the largest error.
+void ReduceAnimation(reduce_bone *Bones, u32 BoneCount, f32 MaxError);
+
+#endif
@@ -52,6 +52,19 @@ struct dais_listing {
 
 struct memory_arena;
 
+typedef u32 dais_io_ticket;
+
+#define DAIS_IO_PENDING  0
+#define DAIS_IO_COMPLETE 1
+#define DAIS_IO_FAILED   2
+
+struct dais_io_request {
+    const char *Filename;
+    /** The file's contents are allocated from this arena
+     *  when the request is submitted, and filled in later. */
+    memory_arena *Arena;
+};
+
 // Dais API typedefs
 #define DAIS_LIST_DIRECTORY(name) dais_listing name(const char *Dir, memory_arena *Arena)
 typedef DAIS_LIST_DIRECTORY(dais_list_directory);
@@ -62,15 +75,75 @@ typedef DAIS_LOAD_FILE_BUFFER(dais_load_file_buffer);
 #define DAIS_FREE_FILE_BUFFER(name) void name(s32 Handle)
 typedef DAIS_FREE_FILE_BUFFER(dais_free_file_buffer);
 
+#define DAIS_SUBMIT_FILE_READS(name) void name(dais_io_request *Requests, dais_io_ticket *Tickets, u32 Count)
+typedef DAIS_SUBMIT_FILE_READS(dais_submit_file_reads);
+
+#define DAIS_COLLECT_FILE_READ(name) s32 name(dais_io_ticket Ticket, dais_file *File)
+typedef DAIS_COLLECT_FILE_READ(dais_collect_file_read);
+
+/** Dais never runs more job threads than this, including the
+ *  main thread, so per-thread state can be sized for it. */
+#define DAIS_MAX_JOB_THREADS 64
+
+/** Job functions must not be stored anywhere that outlives the
+ *  frame.  Dais finishes every job before reloading the game. */
+#define DAIS_JOB_FN(name) void name(void *Data, u32 ThreadIndex)
+typedef DAIS_JOB_FN(dais_job_fn);
+
+struct dais_job {
+    dais_job_fn *Function;
+    void *Data;
+};
+
+/** Counts the unfinished jobs pushed against it.
+ *  Must be zero-initialized before the first push. */
+typedef s32 dais_job_counter;
+
+#define DAIS_PUSH_JOBS(name) void name(dais_job *Jobs, u32 Count, dais_job_counter *Counter)
+typedef DAIS_PUSH_JOBS(dais_push_jobs);
+
+#define DAIS_PUSH_JOB(name) void name(dais_job_fn *Function, void *Data, dais_job_counter *Counter)
+typedef DAIS_PUSH_JOB(dais_push_job);
+
+#define DAIS_WAIT_FOR_COUNTER(name) void name(dais_job_counter *Counter)
+typedef DAIS_WAIT_FOR_COUNTER(dais_wait_for_counter);
+
 #define DAIS_VOID_FN(name) void name(void)
 typedef DAIS_VOID_FN(dais_void_fn);
 
 #define DAIS_READ_COUNTER(name)  u64 name(void)
 typedef DAIS_READ_COUNTER(dais_read_counter);
 
-#define DAIS_SUBMIT_STAT(name)  void name(const char *Name, u64 Time)
+#define DAIS_REGISTER_STAT(name)  u32 name(const char *Name)
+typedef DAIS_REGISTER_STAT(dais_register_stat);
+
+#define DAIS_BEGIN_STAT(name)  void name(u32 StatID)
+typedef DAIS_BEGIN_STAT(dais_begin_stat);
+
+#define DAIS_SUBMIT_STAT(name)  void name(u32 StatID, u64 StartTime, u64 EndTime)
 typedef DAIS_SUBMIT_STAT(dais_submit_stat);
 
+#define DAIS_DUMP_TRACE(name)  b32 name(const char *Filename, u32 FrameCount)
+typedef DAIS_DUMP_TRACE(dais_dump_trace);
+
+struct dais_memory_usage {
+    /** Bytes of address space reserved for game memory. */
+    u64 Reserved;
+    /** Bytes of game memory backed by physical memory. */
+    u64 Resident;
+    /** Bytes of resident game memory in huge pages. */
+    u64 HugePages;
+};
+
+#define DAIS_GET_MEMORY_USAGE(name)  dais_memory_usage name(void)
+typedef DAIS_GET_MEMORY_USAGE(dais_get_memory_usage);
+
+#define DAIS_COMMIT_MEMORY(name)  void name(void *Memory, u64 SizeBytes)
+typedef DAIS_COMMIT_MEMORY(dais_commit_memory);
+
+#define DAIS_DECOMMIT_MEMORY(name)  void name(void *Memory, u64 SizeBytes)
+typedef DAIS_DECOMMIT_MEMORY(dais_decommit_memory);
+
 struct dais {
     b32 Initialized;
 
@@ -84,9 +157,25 @@ struct dais {
 
     b32 JustReloaded;
 
+    /** When this is set, dais sleeps after each frame until
+     *  just enough time is left before vsync to run the next
+     *  one, and only then samples input.  This cuts input
+     *  latency by up to a frame, but a frame that runs longer
+     *  than the recent ones may miss vsync.  It's off by default
+     *  since it also waits on the GPU every frame, so the CPU
+     *  can't queue the next frame while the GPU draws this one.
+     *  Toggled with F8. */
+    b32 LateInputSampling;
+
     u64 MemorySize;
     char *Memory;
 
+    /** The number of threads that may run jobs, including the
+     *  main thread.  Job thread indices are less than this, and
+     *  it's at most DAIS_MAX_JOB_THREADS.  It differs between
+     *  machines, so a recording may be replayed with another. */
+    u32 JobThreadCount;
+
     /** Copies a file's contents into memory.
      *  If the file could not be loaded,
      *  its size will be a negative error code. */
@@ -105,36 +194,100 @@ struct dais {
      *  Only needs to be called if MapReadOnlyFile succeeded. */
     dais_free_file_buffer *UnmapReadOnlyFile;
 
+    /** Queues reads of whole files on a background thread.
+     *  One ticket is written for each request. Memory for each
+     *  file is reserved from the request's arena before this
+     *  returns, so the arena may be used again immediately. */
+    dais_submit_file_reads *SubmitFileReads;
+
+    /** Checks on a submitted read without blocking.
+     *  Returns DAIS_IO_PENDING until the read finishes.
+     *  Once it returns DAIS_IO_COMPLETE or DAIS_IO_FAILED,
+     *  File has been filled in and the ticket is retired. */
+    dais_collect_file_read *PollFileRead;
+
+    /** Like PollFileRead, but blocks until the read finishes. */
+    dais_collect_file_read *WaitFileRead;
+
     /** Lists the contents of a directory.
      *  The list and names are allocated from the given Arena. */
     dais_list_directory *ListDirectory;
 
+    /** Queues a job to run on any job thread. The counter is
+     *  incremented now and decremented when the job finishes. */
+    dais_push_job *PushJob;
+
+    /** Queues several jobs against a single counter. */
+    dais_push_jobs *PushJobs;
+
+    /** Runs queued jobs on the calling thread until
+     *  the counter reaches zero. */
+    dais_wait_for_counter *WaitForCounter;
+
     /** Returns an ascending time counter in nS.
      *  Data returned by this function will
      *  _not_ be repeated in input replay. */
     dais_read_counter *ReadPerformanceCounter;
 
-    /** Submits a performance record. */
+    /** Returns the ID for a named performance stat.
+     *  The same name always maps to the same nonzero ID,
+     *  even across reloads, so IDs may be cached. */
+    dais_register_stat *RegisterPerfStat;
+
+    /** Opens a scope for a performance stat on this thread.
+     *  Scopes opened before it is submitted become its children. */
+    dais_begin_stat *BeginPerfStat;
+
+    /** Closes the innermost scope for the stat, and
+     *  submits its time as a performance record.
+     *  Times come from ReadPerformanceCounter. */
     dais_submit_stat *SubmitPerfStat;
+
+    /** Writes the performance records from the last FrameCount
+     *  frames to a Chrome trace-event JSON file, which can be
+     *  opened in Perfetto or chrome://tracing.
+     *  Returns false if the file could not be written. */
+    dais_dump_trace *DumpPerfTrace;
+
+    /** Makes a range of game memory usable.  Game memory is only
+     *  reserved up front, and touching memory that hasn't been
+     *  committed crashes.  Arenas commit memory as they grow
+     *  once ArenaCommitMemory is set to this.  Exits if the
+     *  memory can't be committed. */
+    dais_commit_memory *CommitMemory;
+
+    /** Releases the physical pages behind a range of game memory.
+     *  The range reads as zero afterwards, and is committed again
+     *  when touched.  Partial pages at the ends are just zeroed. */
+    dais_decommit_memory *DecommitMemory;
+
+    /** Reports how much of game memory is resident.  This walks
+     *  the page tables, so it's too slow to call every frame. */
+    dais_get_memory_usage *GetMemoryUsage;
 };
 
 struct dais_perf_stat {
     dais *Platform;
-    const char *Name;
+    u32 StatID;
     bool Ended;
     u64 StartTime;
 
-    dais_perf_stat(dais *Platform, const char *Name) :
+    /** CachedID should point to storage that lives as long
+     *  as the calling code, and starts out zero. */
+    dais_perf_stat(dais *Platform, u32 *CachedID, const char *Name) :
         Platform(Platform),
-        Name(Name),
-        Ended(false),
-        StartTime(Platform->ReadPerformanceCounter())
-        {}
+        Ended(false)
+    {
+        if (!*CachedID) *CachedID = Platform->RegisterPerfStat(Name);
+        StatID = *CachedID;
+        Platform->BeginPerfStat(StatID);
+        StartTime = Platform->ReadPerformanceCounter();
+    }
 
     inline
     void end() {
         u64 EndTime = Platform->ReadPerformanceCounter();
-        Platform->SubmitPerfStat(Name, EndTime - StartTime);
+        Platform->SubmitPerfStat(StatID, StartTime, EndTime);
         Ended = true;
     }
 
@@ -156,6 +309,10 @@ struct dais_input {
     u32 FrameDeltaMS;
     f32 FrameDeltaSec;
 
+    // exact times, the fields above are rounded from these
+    u64 UpTimeNS;
+    u64 FrameDeltaNS;
+
     s32 WindowWidth;
     s32 WindowHeight;
 
@@ -0,0 +1,368 @@
+#include "dais.h"
+
+#include <stdio.h>
+#include <string.h> // strerror
+
+#include <dirent.h> // opendir et al
+#include <sys/mman.h> // mmap, memfd_create
+#include <sys/time.h> // gettimeofday, for system time
+#include <sys/types.h> // struct dirent
+#include <sys/stat.h>
+#include <sys/inotify.h> // inotify, for hot reload notifications
+#include <sys/sendfile.h> // sendfile, for in-memory module copies
+#include <sys/personality.h> // personality, for reproducible headless runs
+#include <errno.h>
+#include <time.h> // clock_gettime, for accurate monotonic time
+#include <dlfcn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h> // worker threads
+
+#define PCALL(X) LNX##X
+
+#include "dais_shared.h"
+
+// ----------------- Timing ----------------
+
+static inline
+void LNXTimerInit() {
+}
+
+static
+u64 LNXSystemTime() {
+    u64 Now = 0;
+    struct timeval Tv = {};
+    gettimeofday(&Tv, 0);
+    Now = Tv.tv_sec * 1000UL + Tv.tv_usec / 1000UL;
+    return Now;
+}
+
+static
+u64 LNXNanoTime() {
+    struct timespec Ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    u64 Now = Ts.tv_sec * 1000000000UL + Ts.tv_nsec;
+    return Now;
+}
+
+static
+u64 LNXMilliTime() {
+    u64 Now = LNXNanoTime() / 1000000UL;
+    return Now;
+}
+
+static
+u64 LNXNanoClock() {
+    struct timespec Ts = {};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &Ts);
+    u64 Now = Ts.tv_sec * 1000000000UL + Ts.tv_nsec;
+    return Now;
+}
+
+// ----------------- Files ----------------
+
+static
+u64 LNXGetLastModifiedTime(const char *Filename) {
+    u64 LastWrite = 0;
+    struct stat Stats;
+    if (stat(Filename, &Stats) == 0) {
+        LastWrite = Stats.st_mtim.tv_sec;
+    }
+    return LastWrite;
+}
+
+
+// ----------------- Memory -----------------
+
+// The size of the pages backing game memory, which
+// is the granularity at which it can be decommitted.
+static u64 LNXCommitPageSize;
+
+static
+void *LNXReserveMemPages(void *RequestedAddress, u64 SizeBytes) {
+    // Nothing is accessible until it's committed.  Private,
+    // so that decommitted pages really are freed.
+    int Flags = MAP_ANON | MAP_PRIVATE;
+    void *Result = MAP_FAILED;
+    LNXCommitPageSize = (u64) getpagesize();
+
+#if DAIS_HUGE_PAGES == 2
+    // Explicit huge pages come from the hugetlbfs pool, which
+    // is usually empty unless vm.nr_hugepages has been set.
+    // The whole size is reserved from the pool up front, so
+    // this fails here rather than faulting later.
+    Result = mmap(RequestedAddress,
+         SizeBytes,
+         PROT_NONE,
+         Flags | MAP_HUGETLB,
+         -1,
+         0);
+    if (Result != MAP_FAILED) {
+        LNXCommitPageSize = DAIS_HUGE_PAGE_SIZE;
+    } else {
+        printf("INFO: No explicit huge pages available, falling back to transparent huge pages\n");
+    }
+#endif
+
+    if (Result == MAP_FAILED) {
+        Result = mmap(RequestedAddress,
+             SizeBytes,
+             PROT_NONE,
+             Flags | MAP_NORESERVE,
+             -1,
+             0);
+#if DAIS_HUGE_PAGES
+        // Only fully covered, aligned huge pages can be used,
+        // which is why the base address is huge page aligned.
+        if (Result != MAP_FAILED && madvise(Result, SizeBytes, MADV_HUGEPAGE) != 0) {
+            int Err = errno;
+            printf("INFO: Transparent huge pages are unavailable, errno=%d (%s)\n", Err, strerror(Err));
+        }
+#endif
+    }
+    if (Result == MAP_FAILED) Result = 0;
+    return Result;
+}
+
+static
+void LNXCommitMemory(void *Memory, u64 SizeBytes) {
+    // Pages are only backed when first touched, so this just
+    // makes them accessible.  The reservation didn't count
+    // against the commit limit, so neither does this.
+    char *PageStart = (char *) ((uptr) Memory & ~(uptr)(LNXCommitPageSize - 1));
+    char *PageEnd = (char *) AlignRoundUp((uptr) Memory + SizeBytes, (uptr) LNXCommitPageSize);
+    if (mprotect(PageStart, PageEnd - PageStart, PROT_READ | PROT_WRITE) != 0) {
+        int Err = errno;
+        printf("FATAL: Could not commit 0x%llX bytes at %p, errno=%d (%s)\n",
+               (unsigned long long) SizeBytes, Memory, Err, strerror(Err));
+        exit(-1);
+    }
+}
+
+static
+void LNXDecommitMemory(void *Memory, u64 SizeBytes) {
+    // Only whole pages can be released, the ends are zeroed.
+    char *Start = (char *) Memory;
+    char *End = Start + SizeBytes;
+    char *PageStart = (char *) AlignRoundUp((uptr) Start, (uptr) LNXCommitPageSize);
+    char *PageEnd = (char *) ((uptr) End & ~(uptr)(LNXCommitPageSize - 1));
+    if (PageStart >= PageEnd) {
+        memset(Start, 0, SizeBytes);
+        return;
+    }
+    memset(Start, 0, PageStart - Start);
+    memset(PageEnd, 0, End - PageEnd);
+    // Private anonymous pages read as zero after this.
+    if (madvise(PageStart, PageEnd - PageStart, MADV_DONTNEED) != 0) {
+        memset(PageStart, 0, PageEnd - PageStart);
+    }
+}
+
+// Sums the huge pages backing the mapping that starts at Memory,
+// from the kernel's per-mapping accounting in /proc/self/smaps.
+static
+u64 LNXHugePageBytes(void *Memory) {
+    FILE *Smaps = fopen("/proc/self/smaps", "r");
+    if (!Smaps) return 0;
+
+    u64 Total = 0;
+    b32 InMapping = false;
+    char Line[256];
+    while (fgets(Line, sizeof(Line), Smaps)) {
+        unsigned long long Start, End, Kb;
+        if (sscanf(Line, "%llx-%llx ", &Start, &End) == 2) {
+            if (InMapping) break;
+            InMapping = (Start == (uptr) Memory);
+        } else if (InMapping &&
+                (sscanf(Line, "AnonHugePages: %llu kB", &Kb) == 1 ||
+                 sscanf(Line, "Private_Hugetlb: %llu kB", &Kb) == 1 ||
+                 sscanf(Line, "Shared_Hugetlb: %llu kB", &Kb) == 1)) {
+            Total += Kilobytes(Kb);
+        }
+    }
+    fclose(Smaps);
+    return Total;
+}
+
+static
+void LNXFindResidentPages(void *Memory, u64 SizeBytes, u8 *Resident) {
+    // mincore reports one entry per system page, which may be
+    // larger than DAIS_PAGE_SIZE.  Spread each entry across the
+    // dais pages it covers.
+    u64 SystemPageSize = (u64) getpagesize();
+    u64 SystemPageCount = (SizeBytes + SystemPageSize - 1) / SystemPageSize;
+    u64 PageCount = SizeBytes / DAIS_PAGE_SIZE;
+    unsigned char *SystemResident = (unsigned char *) malloc(SystemPageCount);
+    if (!SystemResident || mincore(Memory, SizeBytes, SystemResident) != 0) {
+        memset(Resident, 1, PageCount);
+    } else {
+        for (u64 PageIndex = 0; PageIndex < PageCount; PageIndex++) {
+            Resident[PageIndex] = SystemResident[PageIndex * DAIS_PAGE_SIZE / SystemPageSize] & 1;
+        }
+    }
+    free(SystemResident);
+}
+
+// Mapped files land at randomized addresses, and the game
+// stores pointers to them in its memory.  Re-executes the
+// process with randomization disabled so that headless runs
+// produce comparable memory hashes.
+static
+void LNXDisableAddressRandomization(char **argv) {
+    int Persona = personality(0xffffffff);
+    if (Persona != -1 && !(Persona & ADDR_NO_RANDOMIZE)) {
+        if (personality(Persona | ADDR_NO_RANDOMIZE) != -1) {
+            execv("/proc/self/exe", argv);
+        }
+        printf("WARNING: Couldn't disable address randomization, memory hashes may vary between runs.\n");
+    }
+}
+
+
+// ----------------- Threads -----------------
+
+static
+u32 LNXProcessorCount() {
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    return Count > 0 ? (u32) Count : 1;
+}
+
+
+// ----------------- Hotswap -----------------
+
+typedef int glad_loader_init(GLADloadproc LoadProc);
+
+static
+DAIS_UPDATE_AND_RENDER(StubUpdateAndRender) {
+}
+
+struct target_module {
+    // in-memory copy of the module
+    s32 ModuleHandle;
+    void *Handle;
+    dais_update_and_render *UpdateAndRender;
+    glad_loader_init *GladInit;
+};
+
+struct target_dylib {
+    // inotify instance watching the directory containing
+    // the target.  The linker usually replaces the file
+    // rather than rewriting it, so watching the file
+    // itself would lose track of it after the first build.
+    s32 WatchHandle;
+    b32 Changed;
+
+    // the module that is currently running
+    target_module Module;
+};
+
+static inline
+void LNXInitTarget(target_dylib *Target) {
+    Target->Module.ModuleHandle = -1;
+    Target->Module.UpdateAndRender = StubUpdateAndRender;
+    Target->Changed = true; // force the initial load
+
+    Target->WatchHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (Target->WatchHandle < 0 ||
+            inotify_add_watch(Target->WatchHandle, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        int Err = errno;
+        printf("WARNING: Couldn't watch for changes to %s, hot reload is disabled.\n", DAIS_TARGET_STR);
+        printf("  errno=%d (%s)\n", Err, strerror(Err));
+    }
+}
+
+static inline
+bool LNXTargetChanged(target_dylib *Target) {
+    // In steady state this is a single non-blocking read
+    // that returns EAGAIN, the file system is never touched.
+    if (Target->WatchHandle >= 0) {
+        char Events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t Length;
+        while ((Length = read(Target->WatchHandle, Events, sizeof(Events))) > 0) {
+            char *Pos = Events;
+            while (Pos < Events + Length) {
+                struct inotify_event *Event = (struct inotify_event *) Pos;
+                if (Event->len && strcmp(Event->name, DAIS_TARGET_STR) == 0) {
+                    Target->Changed = true;
+                }
+                Pos += sizeof(struct inotify_event) + Event->len;
+            }
+        }
+    }
+
+    bool Result = Target->Changed;
+    Target->Changed = false;
+    return Result;
+}
+
+// Copies the target into an anonymous in-memory file so that
+// the build can overwrite the original while it's in use,
+// without writing a second copy to disk.
+static
+s32 LNXCopyTargetToMemory() {
+    s32 Source = open(DAIS_TARGET_STR, O_RDONLY | O_CLOEXEC);
+    if (Source < 0) {
+        return -1;
+    }
+
+    s32 Module = -1;
+    struct stat Stats = {};
+    if (fstat(Source, &Stats) == 0) {
+        Module = memfd_create(DAIS_INUSE_STR, MFD_CLOEXEC);
+        if (Module >= 0) {
+            off_t Offset = 0;
+            while (Offset < Stats.st_size) {
+                ssize_t Sent = sendfile(Module, Source, &Offset, Stats.st_size - Offset);
+                if (Sent <= 0) break;
+            }
+            if (Offset != Stats.st_size) {
+                printf("WARNING: Couldn't copy %s into memory\n", DAIS_TARGET_STR);
+                close(Module);
+                Module = -1;
+            }
+        }
+    }
+
+    close(Source);
+    return Module;
+}
+
+// Loads a fresh copy of the target next to the running one.
+// Runs on the reload thread, so it must not touch GL.
+static
+void LNXLoadTarget(target_dylib *Target, target_module *Module) {
+    Module->Handle = 0;
+    Module->UpdateAndRender = 0;
+    Module->GladInit = 0;
+    Module->ModuleHandle = LNXCopyTargetToMemory();
+    if (Module->ModuleHandle >= 0) {
+        char ModulePath[64];
+        snprintf(ModulePath, sizeof(ModulePath), "/proc/self/fd/%d", Module->ModuleHandle);
+        // resolve every symbol now, rather than on the render thread
+        Module->Handle = dlopen(ModulePath, RTLD_LOCAL|RTLD_NOW);
+        if (!Module->Handle) {
+            printf("WARNING: %s\n", dlerror());
+        }
+    }
+    if (Module->Handle) {
+        Module->UpdateAndRender = (dais_update_and_render *)
+                dlsym(Module->Handle, DAIS_UPDATE_FUNC_STR);
+        Module->GladInit = (glad_loader_init *)
+                dlsym(Module->Handle, "gladLoadGLLoader");
+    }
+}
+
+static
+void LNXUnloadTarget(target_module *Module) {
+    if (Module->Handle) {
+        dlclose(Module->Handle);
+        Module->Handle = 0;
+    }
+    if (Module->ModuleHandle >= 0) {
+        close(Module->ModuleHandle);
+        Module->ModuleHandle = -1;
+    }
+}
+
+
+#include "dais_shared.inc"
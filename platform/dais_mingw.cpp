@@ -8,6 +8,7 @@
 #include <io.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <pthread.h> // worker threads
 #include <dirent.h>
 #include <sys/stat.h>
 
@@ -78,12 +79,90 @@ static
 void *MGWReserveMemPages(void *RequestedAddress, u64 SizeBytes) {
     // ignore the requested address
     // 32-bit windows is pretty cramped.  Let the OS place the memory.
+    // Pages are committed as arenas grow.
     return VirtualAlloc(0,
          SizeBytes,
-         MEM_COMMIT,
+         MEM_RESERVE,
          PAGE_READWRITE);
 }
 
+static
+void MGWCommitMemory(void *Memory, u64 SizeBytes) {
+    // committing memory that's already committed is fine
+    if (!VirtualAlloc(Memory, SizeBytes, MEM_COMMIT, PAGE_READWRITE)) {
+        printf("FATAL: Could not commit 0x%llX bytes at %p, error=%lu\n",
+               (unsigned long long) SizeBytes, Memory, GetLastError());
+        exit(-1);
+    }
+}
+
+static
+void MGWDecommitMemory(void *Memory, u64 SizeBytes) {
+    // Only whole pages can be released, the ends are zeroed.
+    // Pages committed again after a decommit read as zero.
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    u64 PageSize = Info.dwPageSize;
+    char *Start = (char *) Memory;
+    char *End = Start + SizeBytes;
+    char *PageStart = (char *) AlignRoundUp((uptr) Start, (uptr) PageSize);
+    char *PageEnd = (char *) ((uptr) End & ~(uptr)(PageSize - 1));
+    if (PageStart >= PageEnd) {
+        memset(Start, 0, SizeBytes);
+        return;
+    }
+    memset(Start, 0, PageStart - Start);
+    memset(PageEnd, 0, End - PageEnd);
+    if (!VirtualFree(PageStart, PageEnd - PageStart, MEM_DECOMMIT) ||
+            !VirtualAlloc(PageStart, PageEnd - PageStart, MEM_COMMIT, PAGE_READWRITE)) {
+        memset(PageStart, 0, PageEnd - PageStart);
+    }
+}
+
+static inline
+u64 MGWHugePageBytes(void *Memory) {
+    // Large pages need a privilege that games don't usually have.
+    return 0;
+}
+
+static
+void MGWFindResidentPages(void *Memory, u64 SizeBytes, u8 *Resident) {
+    // Reports committed pages, since reading the others faults.
+    // Untouched committed pages read as zero, so callers that
+    // skip zero pages still work.
+    char *Base = (char *) Memory;
+    char *Pos = Base;
+    memset(Resident, 0, SizeBytes / DAIS_PAGE_SIZE);
+    while (Pos < Base + SizeBytes) {
+        MEMORY_BASIC_INFORMATION Info;
+        if (!VirtualQuery(Pos, &Info, sizeof(Info))) break;
+        char *End = (char *) Info.BaseAddress + Info.RegionSize;
+        if (End > Base + SizeBytes) End = Base + SizeBytes;
+        if (Info.State == MEM_COMMIT) {
+            u64 First = (Pos - Base) / DAIS_PAGE_SIZE;
+            u64 Last = (End - Base) / DAIS_PAGE_SIZE;
+            memset(Resident + First, 1, Last - First);
+        }
+        Pos = End;
+    }
+}
+
+static inline
+void MGWDisableAddressRandomization(char **argv) {
+    // Not supported here.  Memory hashes from headless runs
+    // may vary if the game stores pointers to mapped files.
+}
+
+
+// ----------------- Threads -----------------
+
+static
+u32 MGWProcessorCount() {
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return Info.dwNumberOfProcessors > 0 ? (u32) Info.dwNumberOfProcessors : 1;
+}
+
 
 
 
@@ -95,43 +174,67 @@ static
 DAIS_UPDATE_AND_RENDER(StubUpdateAndRender) {
 }
 
-struct target_dylib {
-    u64 LastModified;
+// The running module keeps its copy open while the next one
+// loads, so loads alternate between two copies.
+static const char *InUseNames[] = { DAIS_INUSE_STR, "next_" DAIS_INUSE_STR };
+
+struct target_module {
     void *Handle;
     dais_update_and_render *UpdateAndRender;
+    glad_loader_init *GladInit;
+};
+
+struct target_dylib {
+    u64 LastModified;
+    u32 NextInUse;
+
+    // the module that is currently running
+    target_module Module;
 };
 
+static inline
+void MGWInitTarget(target_dylib *Target) {
+    Target->LastModified = 1; // force the initial load
+    Target->Module.UpdateAndRender = StubUpdateAndRender;
+}
 
 static inline
-void MGWUpdateTarget(target_dylib *Target) {
-    if (Target->Handle) {
-        dlclose(Target->Handle);
+bool MGWTargetChanged(target_dylib *Target) {
+    u64 DylibLastModified = MGWGetLastModifiedTime(DAIS_TARGET_STR);
+    bool Changed = Target->LastModified == 1 ||
+        (DylibLastModified != 0 && DylibLastModified != Target->LastModified);
+    if (Changed) {
+        Target->LastModified = DylibLastModified;
     }
+    return Changed;
+}
 
-    CopyFile(DAIS_TARGET_STR, DAIS_INUSE_STR, false);
-
-    Target->LastModified = MGWGetLastModifiedTime(DAIS_INUSE_STR);
-    Target->Handle = dlopen(DAIS_INUSE_STR, RTLD_LOCAL|RTLD_LAZY);
-    Target->UpdateAndRender = 0;
-    if (Target->Handle) {
-        Target->UpdateAndRender = (dais_update_and_render *)
-                dlsym(Target->Handle, DAIS_UPDATE_FUNC_STR);
-        glad_loader_init *GladInit = (glad_loader_init *)
-                dlsym(Target->Handle, "gladLoadGLLoader");
-        if (GladInit) {
-            if (!GladInit((GLADloadproc) glfwGetProcAddress)) {
-                printf("WARNING: Couldn't init GLAD loader in new dll\n");
-            }
-        } else {
-            printf("WARNING: GLAD loader not found in new dll\n");
-        }
+// Loads a fresh copy of the target next to the running one.
+// Runs on the reload thread, so it must not touch GL.
+static
+void MGWLoadTarget(target_dylib *Target, target_module *Module) {
+    const char *InUse = InUseNames[Target->NextInUse];
+    Target->NextInUse ^= 1;
+
+    CopyFile(DAIS_TARGET_STR, InUse, false);
+
+    // resolve every symbol now, rather than on the render thread
+    Module->Handle = dlopen(InUse, RTLD_LOCAL|RTLD_NOW);
+    Module->UpdateAndRender = 0;
+    Module->GladInit = 0;
+    if (Module->Handle) {
+        Module->UpdateAndRender = (dais_update_and_render *)
+                dlsym(Module->Handle, DAIS_UPDATE_FUNC_STR);
+        Module->GladInit = (glad_loader_init *)
+                dlsym(Module->Handle, "gladLoadGLLoader");
     }
+}
 
-    if (!Target->UpdateAndRender) {
-        Target->UpdateAndRender = StubUpdateAndRender;
-        printf("WARNING: Couldn't load target %s\n", DAIS_TARGET_STR);
-    } else {
-        printf("INFO: Updating Game Code\n");
+static
+void MGWUnloadTarget(target_module *Module) {
+    if (Module->Handle) {
+        dlclose(Module->Handle);
+        Module->Handle = 0;
     }
 }
 
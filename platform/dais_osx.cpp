@@ -16,6 +16,7 @@
 #include <dlfcn.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h> // worker threads
 
 #define PCALL(X) OSX##X
 
@@ -75,9 +76,10 @@ u64 OSXGetLastModifiedTime(const char *Filename) {
 
 static
 void *OSXReserveMemPages(void *RequestedAddress, u64 SizeBytes) {
+    // nothing is accessible until it's committed
     void *Result = mmap(RequestedAddress,
          SizeBytes,
-         PROT_READ | PROT_WRITE,
+         PROT_NONE,
          MAP_ANON | MAP_SHARED,
          -1,
          0);
@@ -85,6 +87,87 @@ void *OSXReserveMemPages(void *RequestedAddress, u64 SizeBytes) {
     return Result;
 }
 
+static
+void OSXCommitMemory(void *Memory, u64 SizeBytes) {
+    // Pages are only backed when first touched,
+    // so this just makes them accessible.
+    u64 PageSize = (u64) getpagesize();
+    char *PageStart = (char *) ((uptr) Memory & ~(uptr)(PageSize - 1));
+    char *PageEnd = (char *) AlignRoundUp((uptr) Memory + SizeBytes, (uptr) PageSize);
+    if (mprotect(PageStart, PageEnd - PageStart, PROT_READ | PROT_WRITE) != 0) {
+        int Err = errno;
+        printf("FATAL: Could not commit 0x%llX bytes at %p, errno=%d (%s)\n",
+               (unsigned long long) SizeBytes, Memory, Err, strerror(Err));
+        exit(-1);
+    }
+}
+
+static
+void OSXDecommitMemory(void *Memory, u64 SizeBytes) {
+    // Only whole pages can be released, the ends are zeroed.
+    // madvise doesn't zero pages here, so map fresh ones over them.
+    u64 PageSize = (u64) getpagesize();
+    char *Start = (char *) Memory;
+    char *End = Start + SizeBytes;
+    char *PageStart = (char *) AlignRoundUp((uptr) Start, (uptr) PageSize);
+    char *PageEnd = (char *) ((uptr) End & ~(uptr)(PageSize - 1));
+    if (PageStart >= PageEnd) {
+        memset(Start, 0, SizeBytes);
+        return;
+    }
+    memset(Start, 0, PageStart - Start);
+    memset(PageEnd, 0, End - PageEnd);
+    void *Result = mmap(PageStart,
+         PageEnd - PageStart,
+         PROT_READ | PROT_WRITE,
+         MAP_ANON | MAP_SHARED | MAP_FIXED,
+         -1,
+         0);
+    if (Result == MAP_FAILED) {
+        memset(PageStart, 0, PageEnd - PageStart);
+    }
+}
+
+static inline
+u64 OSXHugePageBytes(void *Memory) {
+    // Not supported here.
+    return 0;
+}
+
+static
+void OSXFindResidentPages(void *Memory, u64 SizeBytes, u8 *Resident) {
+    // mincore reports one entry per system page, which may be
+    // larger than DAIS_PAGE_SIZE.  Spread each entry across the
+    // dais pages it covers.
+    u64 SystemPageSize = (u64) getpagesize();
+    u64 SystemPageCount = (SizeBytes + SystemPageSize - 1) / SystemPageSize;
+    u64 PageCount = SizeBytes / DAIS_PAGE_SIZE;
+    char *SystemResident = (char *) malloc(SystemPageCount);
+    if (!SystemResident || mincore(Memory, SizeBytes, SystemResident) != 0) {
+        memset(Resident, 1, PageCount);
+    } else {
+        for (u64 PageIndex = 0; PageIndex < PageCount; PageIndex++) {
+            Resident[PageIndex] = SystemResident[PageIndex * DAIS_PAGE_SIZE / SystemPageSize] & 1;
+        }
+    }
+    free(SystemResident);
+}
+
+static inline
+void OSXDisableAddressRandomization(char **argv) {
+    // Not supported here.  Memory hashes from headless runs
+    // may vary if the game stores pointers to mapped files.
+}
+
+
+// ----------------- Threads -----------------
+
+static
+u32 OSXProcessorCount() {
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    return Count > 0 ? (u32) Count : 1;
+}
+
 
 // ----------------- Hotswap -----------------
 
@@ -94,43 +177,67 @@ static
 DAIS_UPDATE_AND_RENDER(StubUpdateAndRender) {
 }
 
-struct target_dylib {
-    u64 LastModified;
+// The running module keeps its copy open while the next one
+// loads, so loads alternate between two copies.
+static const char *InUseNames[] = { DAIS_INUSE_STR, "next_" DAIS_INUSE_STR };
+
+struct target_module {
     void *Handle;
     dais_update_and_render *UpdateAndRender;
+    glad_loader_init *GladInit;
 };
 
+struct target_dylib {
+    u64 LastModified;
+    u32 NextInUse;
+
+    // the module that is currently running
+    target_module Module;
+};
+
+static inline
+void OSXInitTarget(target_dylib *Target) {
+    Target->LastModified = 1; // force the initial load
+    Target->Module.UpdateAndRender = StubUpdateAndRender;
+}
 
 static inline
-void OSXUpdateTarget(target_dylib *Target) {
-    if (Target->Handle) {
-        dlclose(Target->Handle);
+bool OSXTargetChanged(target_dylib *Target) {
+    u64 DylibLastModified = OSXGetLastModifiedTime(DAIS_TARGET_STR);
+    bool Changed = Target->LastModified == 1 ||
+        (DylibLastModified != 0 && DylibLastModified != Target->LastModified);
+    if (Changed) {
+        Target->LastModified = DylibLastModified;
     }
+    return Changed;
+}
 
-    copyfile(DAIS_TARGET_STR, DAIS_INUSE_STR, 0, COPYFILE_ALL);
-
-    Target->LastModified = OSXGetLastModifiedTime(DAIS_INUSE_STR);
-    Target->Handle = dlopen(DAIS_INUSE_STR, RTLD_LOCAL|RTLD_LAZY);
-    Target->UpdateAndRender = 0;
-    if (Target->Handle) {
-        Target->UpdateAndRender = (dais_update_and_render *)
-                dlsym(Target->Handle, DAIS_UPDATE_FUNC_STR);
-        glad_loader_init *GladInit = (glad_loader_init *)
-                dlsym(Target->Handle, "gladLoadGLLoader");
-        if (GladInit) {
-            if (!GladInit((GLADloadproc) glfwGetProcAddress)) {
-                printf("WARNING: Couldn't init GLAD loader in new dll\n");
-            }
-        } else {
-            printf("WARNING: GLAD loader not found in new dll\n");
-        }
+// Loads a fresh copy of the target next to the running one.
+// Runs on the reload thread, so it must not touch GL.
+static
+void OSXLoadTarget(target_dylib *Target, target_module *Module) {
+    const char *InUse = InUseNames[Target->NextInUse];
+    Target->NextInUse ^= 1;
+
+    copyfile(DAIS_TARGET_STR, InUse, 0, COPYFILE_ALL);
+
+    // resolve every symbol now, rather than on the render thread
+    Module->Handle = dlopen(InUse, RTLD_LOCAL|RTLD_NOW);
+    Module->UpdateAndRender = 0;
+    Module->GladInit = 0;
+    if (Module->Handle) {
+        Module->UpdateAndRender = (dais_update_and_render *)
+                dlsym(Module->Handle, DAIS_UPDATE_FUNC_STR);
+        Module->GladInit = (glad_loader_init *)
+                dlsym(Module->Handle, "gladLoadGLLoader");
     }
+}
 
-    if (!Target->UpdateAndRender) {
-        Target->UpdateAndRender = StubUpdateAndRender;
-        printf("WARNING: Couldn't load target %s\n", DAIS_TARGET_STR);
-    } else {
-        printf("INFO: Updating Game Code\n");
+static
+void OSXUnloadTarget(target_module *Module) {
+    if (Module->Handle) {
+        dlclose(Module->Handle);
+        Module->Handle = 0;
     }
 }
 
@@ -14,10 +14,29 @@
 #define DAIS_BASE_ADDRESS 0x400000000UL
 #endif
 
+// Game memory is only reserved up front and committed as the
+// game's arenas grow, so this can be far more than is used.
 #ifndef DAIS_MEM_SIZE
 #define DAIS_MEM_SIZE Gigabytes(1)
 #endif
 
+// The granularity of memory snapshots and hashes.
+#ifndef DAIS_PAGE_SIZE
+#define DAIS_PAGE_SIZE Kilobytes(4)
+#endif
+
+// How game memory is backed on Linux.
+// 0: normal pages only
+// 1: transparent huge pages where the kernel allows them
+// 2: explicit huge pages, falling back to transparent ones
+#ifndef DAIS_HUGE_PAGES
+#define DAIS_HUGE_PAGES 1
+#endif
+
+#ifndef DAIS_HUGE_PAGE_SIZE
+#define DAIS_HUGE_PAGE_SIZE Megabytes(2)
+#endif
+
 #ifndef DAIS_TARGET
 #define DAIS_TARGET libgame.so
 #endif
@@ -70,3 +89,11 @@ const u32 DebugColors[] = {
 // ----------------- Forward Declarations ------------------
 
 u64 GetLastModifiedTime(const char *Filename);
+
+
+// ----------------- Shared State ------------------
+
+/** The loader used to resolve GL functions, both in the
+ *  platform layer and in each newly loaded target.
+ *  Headless mode replaces this with a stub loader. */
+static GLADloadproc GLProcLoader = (GLADloadproc) glfwGetProcAddress;
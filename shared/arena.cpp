@@ -1,14 +1,177 @@
 struct memory_arena {
     char *Base;
-    u32 Pos;
-    u32 Capacity;
+    u64 Pos;
+    u64 Capacity;
+    /** Bytes from Base that have been committed.
+     *  The rest of the capacity is only reserved. */
+    u64 Committed;
 };
 
+/** Marks a point in an arena to return to, from ArenaBeginTemp. */
+struct arena_temp {
+    memory_arena *Arena;
+    u64 Pos;
+};
+
+// Arenas commit their memory in steps of this size as they grow,
+// which keeps the number of commit calls low.  Matches the huge
+// page size so that committed memory can be backed by them.
+#ifndef ARENA_COMMIT_SIZE
+#define ARENA_COMMIT_SIZE Megabytes(2)
+#endif
+
+// Freed tails at least this big are decommitted, if
+// ArenaDecommitMemory is set.  Small tails are left alone
+// so that arenas cleared every frame don't fault their
+// pages back in every frame.
+#ifndef ARENA_DECOMMIT_THRESHOLD
+#define ARENA_DECOMMIT_THRESHOLD Megabytes(2)
+#endif
+
+// Freed memory isn't zeroed, so allocations hold whatever
+// was there before unless they use ArenaAllocZero.  With
+// ARENA_DEBUG set, freed memory is filled with this byte
+// instead, so reads of stale or uninitialized memory stand out.
+#ifndef ARENA_DEBUG
+#define ARENA_DEBUG 0
+#endif
+#define ARENA_POISON 0xCD
+
+// If set, arenas call this before using memory past what
+// they have committed.  Otherwise memory is assumed usable.
+static dais_commit_memory *ArenaCommitMemory;
+static dais_decommit_memory *ArenaDecommitMemory;
+
+// ----------------- Allocation Tracking ----------------
+
+// With ARENA_TRACKING set, every allocation is counted against
+// the file and line that made it, per arena.  The allocation
+// functions pick up their caller's location through defaulted
+// arguments, so call sites don't change.  Wrappers that allocate
+// for their callers can take ARENA_SITE and pass ARENA_SITE_ARGS
+// to charge their callers instead.
+#ifndef ARENA_TRACKING
+#define ARENA_TRACKING 0
+#endif
+
+#if ARENA_TRACKING
+
+#define ARENA_SITE , const char *SiteFile = __builtin_FILE(), u32 SiteLine = __builtin_LINE()
+#define ARENA_SITE_ARGS , SiteFile, SiteLine
+
+#define ARENA_MAX_SITES 1024
+#define ARENA_SITE_HASH_SIZE 4096 // must be a power of two
+
+struct arena_alloc_site {
+    const char *File;
+    u32 Line;
+    memory_arena *Arena;
+    u64 TotalBytes;
+    u64 TotalCount;
+    // since the last call to ArenaTrackingEndFrame
+    u64 FrameBytes;
+    u64 FrameCount;
+    // during the last complete frame
+    u64 LastFrameBytes;
+    u64 LastFrameCount;
+};
+
+static arena_alloc_site ArenaSites[ARENA_MAX_SITES];
+static u32 ArenaSiteCount;
+// index + 1 of the site in each slot, or 0
+static u16 ArenaSiteHash[ARENA_SITE_HASH_SIZE];
+// allocations may come from any job thread
+static s32 ArenaSiteLock;
+
+static
+arena_alloc_site *ArenaFindSite(memory_arena *Arena, const char *File, u32 Line) {
+    u32 Hash = (u32) (((uptr) Arena >> 4) * 0x9E3779B1u) ^ (Line * 0x85EBCA6Bu);
+    for (u32 Probe = 0; Probe < ARENA_SITE_HASH_SIZE; Probe++) {
+        u32 Slot = (Hash + Probe) & (ARENA_SITE_HASH_SIZE - 1);
+        u32 Index = ArenaSiteHash[Slot];
+        if (Index == 0) {
+            if (ArenaSiteCount >= ARENA_MAX_SITES - 1) break;
+            arena_alloc_site *Site = ArenaSites + ArenaSiteCount++;
+            Site->File = File;
+            Site->Line = Line;
+            Site->Arena = Arena;
+            ArenaSiteHash[Slot] = (u16) ArenaSiteCount;
+            return Site;
+        }
+        arena_alloc_site *Site = ArenaSites + (Index - 1);
+        if (Site->Line == Line && Site->Arena == Arena &&
+                (Site->File == File || strcmp(Site->File, File) == 0)) {
+            return Site;
+        }
+    }
+    // out of sites, lump the rest together in the last one
+    arena_alloc_site *Other = ArenaSites + ARENA_MAX_SITES - 1;
+    Other->File = "(other sites)";
+    ArenaSiteCount = ARENA_MAX_SITES;
+    return Other;
+}
+
+static
+void ArenaTrackAlloc(memory_arena *Arena, u64 Size, const char *File, u32 Line) {
+    while (__atomic_test_and_set(&ArenaSiteLock, __ATOMIC_ACQUIRE)) {}
+    arena_alloc_site *Site = ArenaFindSite(Arena, File, Line);
+    Site->TotalBytes += Size;
+    Site->TotalCount++;
+    Site->FrameBytes += Size;
+    Site->FrameCount++;
+    __atomic_clear(&ArenaSiteLock, __ATOMIC_RELEASE);
+}
+
+/** Returns the number of call sites seen so far, and points
+ *  Sites at them.  Sites are never removed, and their order
+ *  doesn't change.  Only call this between frames, or on
+ *  the thread that ends them. */
 static inline
-void ArenaInit(memory_arena *Arena, void *Base, u32 Capacity) {
+u32 ArenaGetAllocSites(arena_alloc_site **Sites) {
+    *Sites = ArenaSites;
+    return ArenaSiteCount;
+}
+
+/** Starts a new frame of per-frame counts. */
+static
+void ArenaTrackingEndFrame() {
+    while (__atomic_test_and_set(&ArenaSiteLock, __ATOMIC_ACQUIRE)) {}
+    for (u32 Index = 0; Index < ArenaSiteCount; Index++) {
+        arena_alloc_site *Site = ArenaSites + Index;
+        Site->LastFrameBytes = Site->FrameBytes;
+        Site->LastFrameCount = Site->FrameCount;
+        Site->FrameBytes = 0;
+        Site->FrameCount = 0;
+    }
+    __atomic_clear(&ArenaSiteLock, __ATOMIC_RELEASE);
+}
+
+#else
+
+#define ARENA_SITE
+#define ARENA_SITE_ARGS
+
+#endif
+
+
+// ----------------- Arenas ----------------
+
+static inline
+void ArenaInit(memory_arena *Arena, void *Base, u64 Capacity) {
     Arena->Base = (char *) Base;
     Arena->Pos = 0;
     Arena->Capacity = Capacity;
+    Arena->Committed = 0;
+}
+
+static
+void ArenaCommit(memory_arena *Arena, u64 End) {
+    u64 Committed = AlignRoundUp(End, ARENA_COMMIT_SIZE);
+    if (Committed > Arena->Capacity) Committed = Arena->Capacity;
+    if (ArenaCommitMemory) {
+        ArenaCommitMemory(Arena->Base + Arena->Committed, Committed - Arena->Committed);
+    }
+    Arena->Committed = Committed;
 }
 
 static inline
@@ -16,57 +179,127 @@ void ArenaAlign(memory_arena *Arena, u32 Align) {
     Assert(IsPowerOfTwo(Align));
     uptr Pos = (uptr) (Arena->Base + Arena->Pos);
     Pos = AlignRoundUp(Pos, (uptr) Align);
-    Arena->Pos = (u32)(Pos - (uptr)(Arena->Base));
+    Arena->Pos = (u64)(Pos - (uptr)(Arena->Base));
+    if (Arena->Pos > Arena->Committed) ArenaCommit(Arena, Arena->Pos);
 }
 
 static
-void *ArenaAlloc(memory_arena *Arena, u32 Size) {
+void *ArenaAlloc(memory_arena *Arena, u64 Size ARENA_SITE) {
+#if ARENA_TRACKING
+    ArenaTrackAlloc(Arena, Size, SiteFile, SiteLine);
+#endif
     Assert(Arena->Pos + Size >= Arena->Pos); // overflow check
     Assert(Arena->Pos + Size <= Arena->Capacity); // bounds check
     char *Alloc = Arena->Base + Arena->Pos;
     Arena->Pos += Size;
+    if (Arena->Pos > Arena->Committed) ArenaCommit(Arena, Arena->Pos);
+    return Alloc;
+}
+
+static inline
+void *ArenaAlloc(memory_arena *Arena, u64 Size, u64 Count ARENA_SITE) {
+    return ArenaAlloc(Arena, Size * Count ARENA_SITE_ARGS);
+}
+
+// Safe to call from several threads at once, for results that
+// must outlive the job that made them.  Must not run alongside
+// the other arena functions on the same arena.
+static
+void *ArenaAllocAtomic(memory_arena *Arena, u64 Size ARENA_SITE) {
+#if ARENA_TRACKING
+    ArenaTrackAlloc(Arena, Size, SiteFile, SiteLine);
+#endif
+    u64 Pos = __atomic_fetch_add(&Arena->Pos, Size, __ATOMIC_RELAXED);
+    u64 End = Pos + Size;
+    Assert(End >= Pos); // overflow check
+    Assert(End <= Arena->Capacity); // bounds check
+    u64 Committed = __atomic_load_n(&Arena->Committed, __ATOMIC_ACQUIRE);
+    if (End > Committed) {
+        // Threads racing past the same point all commit the memory
+        // they need before raising Committed, which is harmless.
+        u64 NewCommitted = AlignRoundUp(End, ARENA_COMMIT_SIZE);
+        if (NewCommitted > Arena->Capacity) NewCommitted = Arena->Capacity;
+        if (ArenaCommitMemory) {
+            ArenaCommitMemory(Arena->Base + Committed, NewCommitted - Committed);
+        }
+        while (Committed < NewCommitted &&
+               !__atomic_compare_exchange_n(&Arena->Committed, &Committed, NewCommitted,
+                                            true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {}
+    }
+    return Arena->Base + Pos;
+}
+
+static inline
+void *ArenaAllocZero(memory_arena *Arena, u64 Size ARENA_SITE) {
+    void *Alloc = ArenaAlloc(Arena, Size ARENA_SITE_ARGS);
+    memset(Alloc, 0, Size);
     return Alloc;
 }
 
 static inline
-void *ArenaAlloc(memory_arena *Arena, u32 Size, u32 Count) {
-    return ArenaAlloc(Arena, Size * Count);
+void ArenaFreeTail(memory_arena *Arena, u64 Pos) {
+    u64 Size = Arena->Pos - Pos;
+#if ARENA_DEBUG
+    memset(Arena->Base + Pos, ARENA_POISON, Size);
+#else
+    if (ArenaDecommitMemory && Size >= ARENA_DECOMMIT_THRESHOLD) {
+        ArenaDecommitMemory(Arena->Base + Pos, Size);
+    }
+#endif
 }
 
 static inline
 void ArenaClear(memory_arena *Arena) {
-    memset(Arena->Base, 0, Arena->Pos);
+    ArenaFreeTail(Arena, 0);
     Arena->Pos = 0;
 }
 
 static
-void ArenaRestore(memory_arena *Arena, u32 Pos) {
+void ArenaRestore(memory_arena *Arena, u64 Pos) {
     if (Pos < Arena->Pos) {
-        memset(Arena->Base + Pos, 0, Arena->Pos - Pos);
+        ArenaFreeTail(Arena, Pos);
         Arena->Pos = Pos;
     }
 }
 
+// Everything allocated between ArenaBeginTemp and
+// the matching ArenaEndTemp is freed by the end.
+// Scopes on the same arena must nest.
+static inline
+arena_temp ArenaBeginTemp(memory_arena *Arena) {
+    arena_temp Temp;
+    Temp.Arena = Arena;
+    Temp.Pos = Arena->Pos;
+    return Temp;
+}
+
+static inline
+void ArenaEndTemp(arena_temp Temp) {
+    Assert(Temp.Arena->Pos >= Temp.Pos); // scopes must nest
+    ArenaRestore(Temp.Arena, Temp.Pos);
+}
+
 static
-void *ArenaCopy(memory_arena *Arena, const void *Ptr, u32 Size) {
-    void *Mem = ArenaAlloc(Arena, Size);
+void *ArenaCopy(memory_arena *Arena, const void *Ptr, u64 Size ARENA_SITE) {
+    void *Mem = ArenaAlloc(Arena, Size ARENA_SITE_ARGS);
     memcpy(Mem, Ptr, Size);
     return Mem;
 }
 
 static
-char *ArenaStrcpy(memory_arena *Arena, const char *Str) {
-    u32 Len = strlen(Str);
-    return (char *) ArenaCopy(Arena, Str, Len+1);
+char *ArenaStrcpy(memory_arena *Arena, const char *Str ARENA_SITE) {
+    u64 Len = strlen(Str);
+    return (char *) ArenaCopy(Arena, Str, Len+1 ARENA_SITE_ARGS);
 }
 
 static
-char *ArenaVPrintf(memory_arena *Arena, const char *Format, va_list Argptr) {
-    char *Base = Arena->Base + Arena->Pos;
-    u32 Limit = Arena->Capacity - Arena->Pos;
-    u32 Printed = vsnprintf(Base, Limit - 1, Format, Argptr);
-    Arena->Pos += Printed + 1;
-    Assert(Arena->Pos < Arena->Capacity);
+char *ArenaVPrintf(memory_arena *Arena, const char *Format, va_list Argptr ARENA_SITE) {
+    va_list Copy;
+    va_copy(Copy, Argptr);
+    u32 Printed = vsnprintf(0, 0, Format, Copy);
+    va_end(Copy);
+    char *Base = (char *) ArenaAlloc(Arena, Printed + 1 ARENA_SITE_ARGS);
+    vsnprintf(Base, Printed + 1, Format, Argptr);
     return Base;
 }
 
@@ -85,6 +318,16 @@ char *ArenaPrintf(memory_arena *Arena, const char *Format, ...) {
 #define ArenaAllocTN(ARENA, TYPE, COUNT) \
     ((TYPE *) ArenaAlloc(ARENA, sizeof(TYPE) * (COUNT)))
 
+#define ArenaAllocAtomicT(ARENA, TYPE) \
+    ((TYPE *) ArenaAllocAtomic(ARENA, sizeof(TYPE)))
+#define ArenaAllocAtomicTN(ARENA, TYPE, COUNT) \
+    ((TYPE *) ArenaAllocAtomic(ARENA, sizeof(TYPE) * (COUNT)))
+
+#define ArenaAllocZeroT(ARENA, TYPE) \
+    ((TYPE *) ArenaAllocZero(ARENA, sizeof(TYPE)))
+#define ArenaAllocZeroTN(ARENA, TYPE, COUNT) \
+    ((TYPE *) ArenaAllocZero(ARENA, sizeof(TYPE) * (COUNT)))
+
 #define ArenaCopyT(ARENA, VALUE, TYPE) \
     ((TYPE *) ArenaCopy(ARENA, VALUE, sizeof(TYPE)))
 #define ArenaCopyTN(ARENA, VALUE, TYPE, COUNT) \